@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Check every chacha backend built in against the known answer and the plain
+ * C rounds, for every round count and partial batch, as the module does at
+ * load. make check runs it natively, with the NEON and MIPS32r2 code built for
+ * this host, and under qemu-user for the arm, arm64 and MIPS cross builds.
+ */
+#include <stdio.h>
+#include "../src/chacha.c"
+
+int main(void)
+{
+	static u8 in[CHACHA_MAX_LANES * CHACHA_INPUT_SIZE];
+	static u8 out[CHACHA_MAX_LANES * CHACHA20_BLOCK_SIZE];
+	static u8 ref[CHACHA_MAX_LANES * CHACHA20_BLOCK_SIZE];
+	const struct chacha_backend *const *b;
+	struct chacha_state st;
+	int bad = 0;
+	bool ok;
+
+	for (b = chacha_backends; *b; b++) {
+		if ((*b)->usable && !(*b)->usable()) {
+			printf("chacha %-8s not usable here\n", (*b)->name);
+			continue;
+		}
+
+		ok = chacha_selftest(*b, &st, in, out, ref);
+		printf("chacha %-8s %s\n", (*b)->name, ok ? "ok" : "FAILED");
+		bad |= !ok;
+	}
+
+	return bad;
+}
@@ -0,0 +1 @@
+/* in kshim.h */
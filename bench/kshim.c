@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/* Userspace bodies of the kernel functions declared in kshim.h */
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+int printk(const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+struct page *alloc_page(gfp_t gfp)
+{
+	return malloc(PAGE_SIZE);
+}
+
+void *page_address(const struct page *page)
+{
+	return (void *)page;
+}
+
+/* pages are never freed, the module only shares them between frags */
+struct page *virt_to_head_page(const void *p)
+{
+	return (struct page *)p;
+}
+
+void get_page(struct page *page)
+{
+}
+
+void put_page(struct page *page)
+{
+}
+
+void get_random_bytes(void *buf, int len)
+{
+	u8 *p = buf;
+
+	while (len--)
+		*p++ = random();
+}
+
+static u64 kshim_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long kshim_jiffies(void)
+{
+	return kshim_ns() / (1000000000 / HZ);
+}
+
+ktime_t ktime_get(void)
+{
+	return kshim_ns();
+}
+
+u64 local_clock(void)
+{
+	return kshim_ns();
+}
+
+/* cycles where the CPU has a cycle counter, ns elsewhere */
+cycles_t get_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return kshim_ns();
+#endif
+}
+
+int kshim_cpu_has(int feature)
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	switch (feature) {
+	case X86_FEATURE_XMM2:
+		return __builtin_cpu_supports("sse2");
+	case X86_FEATURE_AVX:
+		return __builtin_cpu_supports("avx");
+	case X86_FEATURE_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case X86_FEATURE_AVX512F:
+		return __builtin_cpu_supports("avx512f");
+	case X86_FEATURE_AES:
+		return __builtin_cpu_supports("aes");
+	}
+#endif
+	return 0;
+}
+
+static u32 csum_fold32(u64 sum)
+{
+	while (sum >> 32)
+		sum = (sum & 0xffffffff) + (sum >> 32);
+	return sum;
+}
+
+__wsum csum_partial(const void *buf, int len, __wsum sum)
+{
+	const u8 *p = buf;
+	u64 s = sum;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		s += p[i] | (p[i + 1] << 8);
+	if (len & 1)
+		s += p[len - 1];
+
+	return csum_fold32(s);
+}
+
+__sum16 csum_tcpudp_magic(__be32 saddr, __be32 daddr, u32 len, u8 proto,
+			  __wsum sum)
+{
+	u64 s = sum;
+
+	s += saddr;
+	s += daddr;
+	s += htons(len);
+	s += proto << 8;
+	return csum_fold(csum_fold32(s));
+}
+
+void ip_send_check(struct iphdr *iph)
+{
+	iph->check = 0;
+	iph->check = csum_fold(csum_partial(iph, KSHIM_IP_HLEN, 0));
+}
+
+void ipv4_change_dsfield(struct iphdr *iph, u8 mask, u8 value)
+{
+	u8 dsfield = (iph->tos & mask) | value;
+
+	csum_replace2(&iph->check, htons(iph->tos), htons(dsfield));
+	iph->tos = dsfield;
+}
+
+void *skb_put(struct sk_buff *skb, unsigned int len)
+{
+	void *tail = skb->head + skb->tail;
+
+	skb->tail += len;
+	skb->len += len;
+	return tail;
+}
+
+int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail, gfp_t gfp)
+{
+	unsigned char *head = malloc(skb->end + nhead + ntail);
+
+	if (!head)
+		return -ENOMEM;
+
+	memcpy(head + nhead, skb->head, skb->end);
+	skb->data = head + nhead + (skb->data - skb->head);
+	free(skb->head);
+	skb->head = head;
+	skb->end += nhead + ntail;
+	skb->tail += nhead;
+	return 0;
+}
+
+int pskb_trim_rcsum(struct sk_buff *skb, unsigned int len)
+{
+	if (skb->ip_summed == CHECKSUM_COMPLETE)
+		skb->csum = csum_block_sub(skb->csum,
+					   csum_partial(skb->data + len,
+							skb->len - len, 0),
+					   len);
+	skb->tail -= skb->len - len;
+	skb->len = len;
+	return 0;
+}
+
+void skb_add_rx_frag(struct sk_buff *skb, int i, struct page *page, int off,
+		     int size, unsigned int truesize)
+{
+	if (skb_tailroom(skb) < size)
+		pskb_expand_head(skb, 0, size, GFP_ATOMIC);
+	memcpy(skb->data + skb->len, (u8 *)page + off, size);
+	skb->tail += size;
+	skb->len += size;
+}
+
+void *netdev_alloc_frag(unsigned int size)
+{
+	return NULL;
+}
+
+void seq_puts(struct seq_file *seq, const char *s)
+{
+	fputs(s, stdout);
+}
+
+void seq_putc(struct seq_file *seq, char c)
+{
+	putchar(c);
+}
+
+void seq_printf(struct seq_file *seq, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
@@ -0,0 +1,696 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Just enough of the kernel API to build the module sources in userspace.
+ * Every compiled file gets this header with -include, the kernel headers in
+ * include/ are empty. An skb is one linear buffer, paged, cloned and shared
+ * skbs are not modelled. The checksum helpers assume a little endian host,
+ * the chacha code, which make check also runs on big endian MIPS, does not.
+ */
+#ifndef _WGOBFS_KSHIM_H
+#define _WGOBFS_KSHIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 6, 0)
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+/* types */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef u16 __be16;
+typedef u32 __be32;
+typedef u64 __be64;
+typedef u16 __le16;
+typedef u32 __le32;
+typedef u64 __le64;
+typedef u16 __sum16;
+typedef u32 __wsum;
+typedef unsigned int gfp_t;
+typedef long long ktime_t;
+typedef unsigned long long cycles_t;
+
+/* annotations */
+#define __init
+#define __exit
+#define __net_init
+#define __net_exit
+#define __percpu
+#define __user
+#define __rcu
+#define __force
+#define __read_mostly
+#undef __always_inline
+#define __always_inline inline
+#define noinline __attribute__((noinline))
+#define ____cacheline_aligned __attribute__((aligned(64)))
+#define ____cacheline_aligned_in_smp ____cacheline_aligned
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define READ_ONCE(x) (x)
+#define WRITE_ONCE(x, v) ((x) = (v))
+#define BUILD_BUG_ON(x) _Static_assert(!(x), #x)
+#define WARN_ON(x) (x)
+#define WARN_ON_ONCE(x) (x)
+
+/* kernel.h */
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define U32_MAX 0xffffffffU
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define container_of(p, t, m) ((t *)((char *)(p) - offsetof(t, m)))
+#define ilog2(n) (63 - __builtin_clzll(n))
+#define EINVAL 22
+#define ENOMEM 12
+#define ENOENT 2
+#define ENODEV 19
+#define EMSGSIZE 90
+#define EOPNOTSUPP 95
+
+#define KERN_ERR ""
+#define KERN_WARNING ""
+#define KERN_INFO ""
+int printk(const char *fmt, ...);
+#define pr_err(...) printk(__VA_ARGS__)
+#define pr_warn(...) printk(__VA_ARGS__)
+#define pr_info(...) printk(__VA_ARGS__)
+#define pr_debug(...) do { } while (0)
+
+/* module.h */
+struct kernel_param {
+	void *arg;
+};
+
+struct kernel_param_ops {
+	int (*get)(char *buf, const struct kernel_param *kp);
+};
+
+#define THIS_MODULE NULL
+#define module_init(f) int kshim_module_init(void) { return f(); }
+#define module_exit(f) void kshim_module_exit(void) { f(); }
+#define module_param_cb(n, o, a, p)
+#define MODULE_PARM_DESC(n, d)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_VERSION(x)
+#define MODULE_ALIAS(x)
+#define EXPORT_SYMBOL_GPL(s)
+int kshim_module_init(void);
+void kshim_module_exit(void);
+
+/* byte order, unaligned access and bit operations */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define htons(x) ((u16)(x))
+#define ntohs(x) ((u16)(x))
+#define htonl(x) ((u32)(x))
+#define ntohl(x) ((u32)(x))
+#define cpu_to_le32(x) __builtin_bswap32(x)
+#define le32_to_cpu(x) __builtin_bswap32(x)
+#define cpu_to_le64(x) __builtin_bswap64(x)
+#define le64_to_cpu(x) __builtin_bswap64(x)
+#else
+#define htons(x) __builtin_bswap16(x)
+#define ntohs(x) __builtin_bswap16(x)
+#define htonl(x) __builtin_bswap32(x)
+#define ntohl(x) __builtin_bswap32(x)
+#define cpu_to_le32(x) (x)
+#define le32_to_cpu(x) (x)
+#define cpu_to_le64(x) (x)
+#define le64_to_cpu(x) (x)
+#endif
+
+static inline u32 rol32(u32 w, unsigned int s)
+{
+	return (w << s) | (w >> (32 - s));
+}
+
+static inline u32 ror32(u32 w, unsigned int s)
+{
+	return (w >> s) | (w << (32 - s));
+}
+
+static inline u64 rol64(u64 w, unsigned int s)
+{
+	return (w << s) | (w >> (64 - s));
+}
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return le32_to_cpu(v);
+}
+
+static inline void put_unaligned_le32(u32 v, void *p)
+{
+	v = cpu_to_le32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline u64 get_unaligned_le64(const void *p)
+{
+	u64 v;
+
+	memcpy(&v, p, sizeof(v));
+	return le64_to_cpu(v);
+}
+
+static inline u32 jhash_1word(u32 a, u32 initval)
+{
+	return (a ^ initval) * 2654435761U;
+}
+
+/* memory */
+#define GFP_ATOMIC 1
+#define GFP_KERNEL 2
+#define PAGE_SIZE 4096
+
+struct page;
+
+#define kmalloc(n, gfp) malloc(n)
+#define kzalloc(n, gfp) calloc(1, n)
+#define kfree(p) free((void *)(p))
+#define kfree_sensitive(p) free((void *)(p))
+#define kzfree(p) free((void *)(p))
+#define memzero_explicit(p, n) memset(p, 0, n)
+struct page *alloc_page(gfp_t gfp);
+void *page_address(const struct page *page);
+struct page *virt_to_head_page(const void *p);
+void get_page(struct page *page);
+void put_page(struct page *page);
+void get_random_bytes(void *buf, int len);
+
+/* per-CPU data, there is one CPU */
+#define DEFINE_PER_CPU(t, n) t n
+#define alloc_percpu(t) ((t *)calloc(1, sizeof(t)))
+#define free_percpu(p) free(p)
+#define this_cpu_ptr(p) (p)
+#define per_cpu_ptr(p, cpu) (p)
+#define per_cpu(v, cpu) (v)
+#define this_cpu_inc(v) ((v)++)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define preempt_disable() do { } while (0)
+#define preempt_enable() do { } while (0)
+#define cpu_relax() do { } while (0)
+
+/* time */
+#define HZ 1000
+#define jiffies kshim_jiffies()
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+#define ktime_to_ns(t) (t)
+unsigned long kshim_jiffies(void);
+ktime_t ktime_get(void);
+u64 local_clock(void);
+cycles_t get_cycles(void);
+
+/* SIMD, usable whenever the CPU has it */
+#define X86_FEATURE_XMM2 1
+#define X86_FEATURE_AVX 2
+#define X86_FEATURE_AVX2 3
+#define X86_FEATURE_AVX512F 4
+#define X86_FEATURE_AES 5
+#define XFEATURE_MASK_SSE 1
+#define XFEATURE_MASK_YMM 2
+#define XFEATURE_MASK_AVX512 4
+#define boot_cpu_has(f) kshim_cpu_has(f)
+#define cpu_has_xfeatures(m, n) 1
+#define irq_fpu_usable() true
+#define kernel_fpu_begin() do { } while (0)
+#define kernel_fpu_end() do { } while (0)
+#define may_use_simd() true
+#define kernel_neon_begin() do { } while (0)
+#define kernel_neon_end() do { } while (0)
+#define cpu_has_neon() true
+#define system_supports_fpsimd() true
+int kshim_cpu_has(int feature);
+
+/* checksums */
+#define CSUM_MANGLED_0 ((__sum16)0xffff)
+__wsum csum_partial(const void *buf, int len, __wsum sum);
+__sum16 csum_tcpudp_magic(__be32 saddr, __be32 daddr, u32 len, u8 proto,
+			  __wsum sum);
+
+static inline __wsum csum_add(__wsum a, __wsum b)
+{
+	u32 r = a + b;
+
+	return r + (r < b);
+}
+
+static inline __wsum csum_sub(__wsum a, __wsum b)
+{
+	return csum_add(a, ~b);
+}
+
+static inline __wsum csum_unfold(__sum16 s)
+{
+	return s;
+}
+
+static inline __sum16 csum_fold(__wsum s)
+{
+	s = (s & 0xffff) + (s >> 16);
+	s = (s & 0xffff) + (s >> 16);
+	return (u16)~s;
+}
+
+static inline __wsum csum_shift(__wsum s, int off)
+{
+	return (off & 1) ? ror32(s, 8) : s;
+}
+
+static inline __wsum csum_block_add(__wsum c, __wsum c2, int off)
+{
+	return csum_add(c, csum_shift(c2, off));
+}
+
+static inline __wsum csum_block_sub(__wsum c, __wsum c2, int off)
+{
+	return csum_sub(c, csum_shift(c2, off));
+}
+
+static inline void csum_replace4(__sum16 *sum, __be32 from, __be32 to)
+{
+	*sum = csum_fold(csum_add(csum_sub(~csum_unfold(*sum), from), to));
+}
+
+static inline void csum_replace2(__sum16 *sum, __be16 from, __be16 to)
+{
+	csum_replace4(sum, from, to);
+}
+
+/* skbuff.h, ip.h, udp.h */
+#define CHECKSUM_NONE 0
+#define CHECKSUM_UNNECESSARY 1
+#define CHECKSUM_COMPLETE 2
+#define CHECKSUM_PARTIAL 3
+#define MAX_SKB_FRAGS 17
+#define IPPROTO_UDP 17
+
+struct sock;
+
+struct sk_buff {
+	unsigned char *head, *data;
+	unsigned int tail, end;	/* offsets from head */
+	unsigned int len, data_len;
+	__be16 protocol;
+	u8 ip_summed;
+	__wsum csum;
+	u16 csum_start, csum_offset;
+	u32 truesize;
+	struct sock *sk;
+};
+
+#define SKBFL_SHARED_FRAG 2
+
+struct skb_shared_info {
+	unsigned int nr_frags;
+	u8 flags;
+};
+
+struct iphdr {
+	u8 ihl:4, version:4;	/* little endian */
+	u8 tos;
+	__be16 tot_len;
+	__be16 id;
+	__be16 frag_off;
+	u8 ttl;
+	u8 protocol;
+	__sum16 check;
+	__be32 saddr;
+	__be32 daddr;
+};
+
+struct udphdr {
+	__be16 source;
+	__be16 dest;
+	__be16 len;
+	__sum16 check;
+};
+
+/* IPv4 without options */
+#define KSHIM_IP_HLEN 20
+
+static inline struct iphdr *ip_hdr(const struct sk_buff *skb)
+{
+	return (struct iphdr *)skb->data;
+}
+
+static inline unsigned char *skb_transport_header(const struct sk_buff *skb)
+{
+	return skb->data + KSHIM_IP_HLEN;
+}
+
+static inline int skb_transport_offset(const struct sk_buff *skb)
+{
+	return KSHIM_IP_HLEN;
+}
+
+/* the transport header is always after an IPv4 header without options */
+static inline void skb_set_transport_header(struct sk_buff *skb,
+					    const int offset)
+{
+}
+
+#define ETH_P_IP 0x0800
+#define IP_MF 0x2000
+#define IP_OFFSET 0x1fff
+
+static inline bool ip_is_fragment(const struct iphdr *iph)
+{
+	return (iph->frag_off & htons(IP_MF | IP_OFFSET)) != 0;
+}
+
+static inline struct udphdr *udp_hdr(const struct sk_buff *skb)
+{
+	return (struct udphdr *)skb_transport_header(skb);
+}
+
+static inline struct skb_shared_info *skb_shinfo(const struct sk_buff *skb)
+{
+	static struct skb_shared_info shinfo;
+
+	return &shinfo;
+}
+
+static inline int skb_tailroom(const struct sk_buff *skb)
+{
+	return skb->end - skb->tail;
+}
+
+static inline bool skb_is_nonlinear(const struct sk_buff *skb)
+{
+	return skb->data_len;
+}
+
+static inline bool skb_is_gso(const struct sk_buff *skb)
+{
+	return false;
+}
+
+/* the packets are linear */
+static inline bool pskb_may_pull(struct sk_buff *skb, unsigned int len)
+{
+	return len <= skb->len;
+}
+
+static inline bool skb_has_frag_list(const struct sk_buff *skb)
+{
+	return false;
+}
+
+static inline bool skb_cloned(const struct sk_buff *skb)
+{
+	return false;
+}
+
+static inline int skb_linearize(struct sk_buff *skb)
+{
+	return 0;
+}
+
+static inline int skb_ensure_writable(struct sk_buff *skb, unsigned int len)
+{
+	return len > skb->len ? -ENOMEM : 0;
+}
+
+static inline void *skb_header_pointer(const struct sk_buff *skb, int off,
+				       int len, void *buf)
+{
+	return off + len > (int)skb->len ? NULL : skb->data + off;
+}
+
+static inline __wsum skb_checksum(const struct sk_buff *skb, int off, int len,
+				  __wsum sum)
+{
+	return csum_partial(skb->data + off, len, sum);
+}
+
+void *skb_put(struct sk_buff *skb, unsigned int len);
+int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail, gfp_t gfp);
+int pskb_trim_rcsum(struct sk_buff *skb, unsigned int len);
+/* the fragment is copied after the linear data */
+void skb_add_rx_frag(struct sk_buff *skb, int i, struct page *page, int off,
+		     int size, unsigned int truesize);
+void *netdev_alloc_frag(unsigned int size);
+void ip_send_check(struct iphdr *iph);
+void ipv4_change_dsfield(struct iphdr *iph, u8 mask, u8 value);
+
+/* x_tables */
+#define NF_DROP 0
+#define NF_ACCEPT 1
+#define XT_CONTINUE 0xFFFFFFFF
+#define NFPROTO_IPV4 2
+#define XT_ALIGN(s) (((s) + 7) & ~7)
+
+struct xt_action_param {
+	const void *targinfo;
+	unsigned int hooknum;
+};
+
+struct xt_tgchk_param {
+	struct net *net;
+	const char *table;
+	void *targinfo;
+	unsigned int hook_mask;
+};
+
+struct xt_tgdtor_param {
+	struct net *net;
+	void *targinfo;
+};
+
+struct xt_target {
+	const char *name;
+	u8 revision;
+	u8 family;
+	const char *table;
+	unsigned int (*target)(struct sk_buff *skb,
+			       const struct xt_action_param *par);
+	int (*checkentry)(const struct xt_tgchk_param *par);
+	void (*destroy)(const struct xt_tgdtor_param *par);
+	unsigned int targetsize;
+	unsigned int usersize;
+	void *me;
+};
+
+static inline int xt_register_targets(struct xt_target *t, unsigned int n)
+{
+	return 0;
+}
+
+static inline void xt_unregister_targets(struct xt_target *t, unsigned int n)
+{
+}
+
+/* lists, locks and u64 counters */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(n) struct list_head n = { &(n), &(n) }
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = container_of((head)->next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = container_of(pos->member.next, typeof(*pos), member))
+
+static inline void list_add_tail(struct list_head *n, struct list_head *h)
+{
+	n->prev = h->prev;
+	n->next = h;
+	h->prev->next = n;
+	h->prev = n;
+}
+
+static inline void list_del(struct list_head *n)
+{
+	n->prev->next = n->next;
+	n->next->prev = n->prev;
+}
+
+struct mutex {
+	int unused;
+};
+
+#define DEFINE_MUTEX(n) struct mutex n
+
+static inline void mutex_lock(struct mutex *m)
+{
+}
+
+static inline void mutex_unlock(struct mutex *m)
+{
+}
+
+struct u64_stats_sync {
+	int unused;
+};
+
+#define u64_stats_init(s) do { } while (0)
+#define u64_stats_update_begin(s) do { } while (0)
+#define u64_stats_update_end(s) do { } while (0)
+
+static inline unsigned int
+u64_stats_fetch_begin(const struct u64_stats_sync *s)
+{
+	return 0;
+}
+
+static inline bool u64_stats_fetch_retry(const struct u64_stats_sync *s,
+					 unsigned int start)
+{
+	return false;
+}
+
+struct static_key_false {
+	bool enabled;
+};
+
+#define DECLARE_STATIC_KEY_FALSE(k) extern struct static_key_false k
+#define DEFINE_STATIC_KEY_FALSE(k) struct static_key_false k
+#define static_branch_unlikely(k) ((k)->enabled)
+#define static_branch_enable(k) ((k)->enabled = true)
+#define static_branch_disable(k) ((k)->enabled = false)
+
+/* /proc, debugfs, generic netlink and network namespaces, all inert */
+struct net {
+	struct proc_dir_entry *proc_net;
+};
+
+struct pernet_operations {
+	int (*init)(struct net *net);
+	void (*exit)(struct net *net);
+};
+
+struct seq_file;
+struct inode;
+struct file;
+struct dentry;
+struct proc_dir_entry;
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	void *read;
+	void *llseek;
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+#define net_eq(a, b) ((a) == (b))
+static inline int register_pernet_subsys(struct pernet_operations *ops)
+{
+	return 0;
+}
+
+static inline void unregister_pernet_subsys(struct pernet_operations *ops)
+{
+}
+
+#define proc_create_net_single(n, m, p, show, d) ((void)(show), (void *)1)
+#define remove_proc_entry(n, p) do { } while (0)
+#define seq_file_net(s) NULL
+#define single_open(f, show, d) ((void)(show), 0)
+#define single_release NULL
+#define seq_read NULL
+#define seq_lseek NULL
+#define DEFINE_SIMPLE_ATTRIBUTE(n, get, set, fmt)		\
+	static const struct file_operations n = {		\
+		.owner = (void *)(get), .read = (void *)(set) }
+#define debugfs_create_dir(n, p) NULL
+#define debugfs_remove_recursive(d) do { } while (0)
+
+static inline struct dentry *
+debugfs_create_file(const char *name, unsigned short mode,
+		    struct dentry *parent, void *data,
+		    const struct file_operations *fops)
+{
+	return NULL;
+}
+
+void seq_puts(struct seq_file *seq, const char *s);
+void seq_putc(struct seq_file *seq, char c);
+void seq_printf(struct seq_file *seq, const char *fmt, ...);
+
+struct nlattr;
+struct nlmsghdr {
+	u32 nlmsg_seq;
+};
+
+struct netlink_callback {
+	struct sk_buff *skb;
+	const struct nlmsghdr *nlh;
+	long args[6];
+};
+
+struct netlink_skb_parms {
+	u32 portid;
+};
+
+struct genl_ops {
+	u8 cmd;
+	int (*dumpit)(struct sk_buff *skb, struct netlink_callback *cb);
+};
+
+struct genl_family {
+	const char *name;
+	int version;
+	bool netnsok;
+	void *module;
+	const struct genl_ops *ops;
+	int n_ops;
+};
+
+#define NLM_F_MULTI 2
+#define NETLINK_CB(skb) (*(struct netlink_skb_parms *)(skb))
+#define sock_net(sk) NULL
+#define genlmsg_put(skb, portid, seq, f, flags, cmd) NULL
+#define genlmsg_end(skb, h) do { } while (0)
+#define genlmsg_cancel(skb, h) do { } while (0)
+#define nla_put_u8(skb, t, v) 0
+#define nla_put_u32(skb, t, v) 0
+#define nla_put_u64_64bit(skb, t, v, pad) 0
+#define nla_nest_start(skb, t) NULL
+#define nla_nest_end(skb, n) do { } while (0)
+
+static inline int genl_register_family(struct genl_family *family)
+{
+	return 0;
+}
+
+static inline int genl_unregister_family(struct genl_family *family)
+{
+	return 0;
+}
+
+/* tracepoints call kshim_trace_<event>(), which a program may define */
+#define TP_PROTO(...) __VA_ARGS__
+#define TP_ARGS(...) __VA_ARGS__
+#define TRACE_DEFINE_ENUM(a)
+#define TRACE_EVENT(name, proto, args, entry, assign, print)		\
+	void kshim_trace_##name(proto) __attribute__((weak));		\
+	static inline void trace_##name(proto)				\
+	{								\
+		if (kshim_trace_##name)					\
+			kshim_trace_##name(args);			\
+	}
+
+#endif /* _WGOBFS_KSHIM_H */
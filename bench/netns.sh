@@ -0,0 +1,176 @@
+#!/bin/bash
+#
+# End to end benchmark of xt_WGOBFS over veth between network namespaces, run
+# as root from the bench directory after make. wgtraffic sends WG-like UDP
+# datagrams one way for a few seconds, in each direction, without and with
+# the WGOBFS rules of the README.
+#
+#   pair    client -- server
+#   relay   client -- relay -- server, the relay obfuscates as in the README
+#
+# The softirq column is the CPU time of softirqs on the whole box during the
+# run, in percent of one CPU.
+
+set -e
+
+secs=5
+mix=imix
+key=mysecretkey
+topo=pair
+targets="off on"
+port=6789
+cport=51820
+wgtraffic=${WGTRAFFIC:-$(dirname "$0")/wgtraffic}
+
+NSC=wgobfs-client
+NSR=wgobfs-relay
+NSS=wgobfs-server
+
+usage() {
+    cat >&2 <<USAGE
+usage: $0 [-t secs] [-m mix] [-k key] [-r] [-n]
+  -t  seconds per run, default 5
+  -m  imix, init, resp, cookie, keepalive or a data length, default imix
+  -k  key of the rules
+  -r  client, relay and server instead of client and server
+  -n  only run without the target
+USAGE
+    exit 2
+}
+
+while getopts "t:m:k:rn" opt; do
+    case $opt in
+    t) secs=$OPTARG ;;
+    m) mix=$OPTARG ;;
+    k) key=$OPTARG ;;
+    r) topo=relay ;;
+    n) targets=off ;;
+    *) usage ;;
+    esac
+done
+
+[ -x "$wgtraffic" ] || { echo "$wgtraffic not found, run make" >&2; exit 1; }
+
+cleanup() {
+    for ns in $NSC $NSR $NSS; do
+        ip netns del $ns 2>/dev/null || true
+    done
+}
+trap cleanup EXIT
+
+nsexec() {
+    ns=$1
+    shift
+    ip netns exec "$ns" "$@"
+}
+
+link() {
+    ip link add "$2" netns "$1" type veth peer name "$4" netns "$3"
+    ip -n "$1" addr add "$5" dev "$2"
+    ip -n "$3" addr add "$6" dev "$4"
+    ip -n "$1" link set "$2" up
+    ip -n "$3" link set "$4" up
+}
+
+setup() {
+    cleanup
+    for ns in $NSC $NSS; do
+        ip netns add $ns
+        ip -n $ns link set lo up
+    done
+
+    if [ $topo = pair ]; then
+        link $NSC veth0 $NSS veth0 10.101.0.1/24 10.101.0.2/24
+        server=10.101.0.2
+        client_dst=10.101.0.2
+        server_dst=10.101.0.1
+        return
+    fi
+
+    ip netns add $NSR
+    link $NSC veth0 $NSR veth0 10.101.1.2/24 10.101.1.1/24
+    link $NSR veth1 $NSS veth0 10.101.2.1/24 10.101.2.2/24
+    nsexec $NSR sysctl -qw net.ipv4.ip_forward=1
+    server=10.101.2.2
+    client_dst=10.101.1.1
+    server_dst=10.101.2.1
+    nsexec $NSR iptables -t nat -A PREROUTING -p udp -d 10.101.1.1 --dport $port \
+        -j DNAT --to-destination $server:$port
+    nsexec $NSR iptables -t nat -A POSTROUTING -p udp -d $server --dport $port \
+        -j MASQUERADE
+}
+
+rules() {
+    if [ "$1" = off ]; then
+        [ -z "$rules_on" ] && return 0
+        for ns in $NSC $NSR $NSS; do
+            [ -e /run/netns/$ns ] && nsexec $ns iptables -t mangle -F
+        done
+        rules_on=
+        return 0
+    fi
+
+    rules_on=1
+
+    if [ $topo = pair ]; then
+        nsexec $NSC iptables -t mangle -I INPUT -p udp -m udp --sport $port \
+            -j WGOBFS --key "$key" --unobfs
+        nsexec $NSC iptables -t mangle -I OUTPUT -p udp -m udp --dport $port \
+            -j WGOBFS --key "$key" --obfs
+    else
+        nsexec $NSR iptables -t mangle -A FORWARD -p udp -d $server --dport $port \
+            -j WGOBFS --key "$key" --obfs
+        nsexec $NSR iptables -t mangle -A FORWARD -p udp -s $server --sport $port \
+            -j WGOBFS --key "$key" --unobfs
+    fi
+
+    nsexec $NSS iptables -t mangle -I INPUT -p udp -m udp --dport $port \
+        -j WGOBFS --key "$key" --unobfs
+    nsexec $NSS iptables -t mangle -I OUTPUT -p udp -m udp --sport $port \
+        -j WGOBFS --key "$key" --obfs
+}
+
+softirq() {
+    awk '/^cpu / { print $8 }' /proc/stat
+}
+
+# run <direction> <target>, the relay needs client to server first, for the
+# NAT of the replies
+run() {
+    if [ $1 = c2s ]; then
+        rns=$NSS sns=$NSC rport=$port dst=$client_dst sport=$cport
+    else
+        rns=$NSC sns=$NSS rport=$cport dst=$server_dst sport=$port
+    fi
+
+    out=$(mktemp)
+    nsexec $rns "$wgtraffic" recv -p $rport -t $((secs + 2)) >"$out" &
+    sleep 0.5
+    si0=$(softirq)
+    sent=$(nsexec $sns "$wgtraffic" send -d $dst -p $rport -s $sport -t $secs -m $mix)
+    si1=$(softirq)
+    wait
+    recv=$(cat "$out")
+    rm -f "$out"
+
+    echo "$sent $recv $((si1 - si0)) $(getconf CLK_TCK)" | awk \
+        -v dir=$1 -v target=$2 '{
+        # sent N pkts B bytes T s recv N pkts B bytes T s softirq hz
+        secs = $13 > 0 ? $13 : 1
+        printf "%-4s %-3s %10.0f pps %8.3f Gbit/s %6.1f%% softirq %5.1f%% lost\n",
+               dir, target, $9 / secs, $11 * 8 / secs / 1e9,
+               $15 * 100 / $16 / $6, $2 ? 100 - $9 * 100 / $2 : 0
+    }'
+}
+
+case "$targets" in
+*on*) modprobe xt_WGOBFS ;;
+esac
+
+setup
+echo "$topo, $mix, $secs s per run"
+for target in $targets; do
+    rules $target
+    run c2s $target
+    run s2c $target
+done
@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Time xt_obfs() and xt_unobfs() of the unmodified module source in
+ * userspace, per WG message type and size, and check every round trip.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include "../src/xt_WGOBFS_main.c"
+
+#define BATCH 64
+#define MAX_ITERS 8
+
+struct msg_case {
+	const char *name;
+	u8 type;
+	int len;
+};
+
+static const struct msg_case cases[] = {
+	{ "handshake_init", WG_HANDSHAKE_INIT, 148 },
+	{ "handshake_resp", WG_HANDSHAKE_RESP, 92 },
+	{ "cookie", WG_COOKIE, 64 },
+	{ "keepalive", WG_DATA, 32 },
+	{ "data", WG_DATA, 128 },
+	{ "data", WG_DATA, 512 },
+	{ "data", WG_DATA, 1024 },
+	{ "data", WG_DATA, 1440 },
+};
+
+static unsigned long prn_iters[MAX_ITERS + 1];
+static unsigned long expands;
+
+void kshim_trace_wgobfs_prn_insert(int rnd_len, int iters)
+{
+	prn_iters[min(iters, MAX_ITERS)]++;
+}
+
+void kshim_trace_wgobfs_expand(unsigned int len, int tailroom, bool cloned,
+			       bool paged)
+{
+	expands++;
+}
+
+struct skb_slot {
+	struct sk_buff skb;
+	unsigned int ret;
+};
+
+/* an IPv4 UDP packet with @msg as payload and @tailroom bytes after it */
+static void skb_build(struct sk_buff *skb, const u8 *msg, const int len,
+		      const int tailroom)
+{
+	const int tot = KSHIM_IP_HLEN + sizeof(struct udphdr) + len;
+	struct iphdr *iph;
+	struct udphdr *udph;
+
+	free(skb->head);
+	memset(skb, 0, sizeof(*skb));
+	skb->head = calloc(1, tot + tailroom);
+	skb->data = skb->head;
+	skb->tail = skb->len = tot;
+	skb->end = tot + tailroom;
+
+	iph = ip_hdr(skb);
+	iph->version = 4;
+	iph->ihl = KSHIM_IP_HLEN / 4;
+	iph->tot_len = htons(tot);
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = htonl(0x0a000001);
+	iph->daddr = htonl(0x0a000002);
+	ip_send_check(iph);
+
+	udph = udp_hdr(skb);
+	udph->source = htons(51820);
+	udph->dest = htons(6789);
+	udph->len = htons(sizeof(struct udphdr) + len);
+	memcpy(udph + 1, msg, len);
+	udph->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+					sizeof(struct udphdr) + len,
+					IPPROTO_UDP,
+					csum_partial(udph,
+						     sizeof(struct udphdr) + len,
+						     0));
+}
+
+static bool skb_matches(const struct sk_buff *skb, const u8 *msg,
+			const int len)
+{
+	const int off = KSHIM_IP_HLEN + sizeof(struct udphdr);
+
+	return skb->len == off + len && !memcmp(skb->data + off, msg, len);
+}
+
+static void msg_fill(u8 *msg, const struct msg_case *c)
+{
+	int i;
+
+	for (i = 0; i < c->len; i++)
+		msg[i] = random();
+	msg[0] = c->type;
+	msg[1] = msg[2] = msg[3] = 0;
+	/* mac2 is zero without a cookie */
+	if (c->type == WG_HANDSHAKE_INIT || c->type == WG_HANDSHAKE_RESP)
+		memset(msg + c->len - 16, 0, 16);
+}
+
+static double per_byte(const u64 cycles, const unsigned long n, const int len)
+{
+	return n ? (double)cycles / n / len : 0;
+}
+
+static int run_case(const struct msg_case *c, const struct wg_obfs_ctx *ctx,
+		    const unsigned long npkts, const int tailroom)
+{
+	static struct skb_slot slots[BATCH];
+	u8 msg[BATCH][1500];
+	u64 obfs_ns = 0, obfs_cyc = 0, unobfs_ns = 0, unobfs_cyc = 0;
+	unsigned long n, nobfs = 0, nunobfs = 0, drops = 0, bad = 0;
+	u64 t0, c0;
+	int i;
+
+	for (n = 0; n < npkts; n += BATCH) {
+		for (i = 0; i < BATCH; i++) {
+			msg_fill(msg[i], c);
+			skb_build(&slots[i].skb, msg[i], c->len, tailroom);
+		}
+
+		t0 = local_clock();
+		c0 = get_cycles();
+		for (i = 0; i < BATCH; i++)
+			slots[i].ret = xt_obfs(&slots[i].skb, ctx);
+		obfs_cyc += get_cycles() - c0;
+		obfs_ns += local_clock() - t0;
+		nobfs += BATCH;
+
+		/* keepalives dropped on purpose are not deobfuscated */
+		t0 = local_clock();
+		c0 = get_cycles();
+		for (i = 0; i < BATCH; i++) {
+			if (slots[i].ret != NF_DROP) {
+				slots[i].ret = xt_unobfs(&slots[i].skb, ctx);
+				nunobfs++;
+			} else {
+				slots[i].ret = XT_CONTINUE + 1;
+			}
+		}
+		unobfs_cyc += get_cycles() - c0;
+		unobfs_ns += local_clock() - t0;
+
+		for (i = 0; i < BATCH; i++) {
+			if (slots[i].ret == XT_CONTINUE + 1)
+				drops++;
+			else if (slots[i].ret != XT_CONTINUE ||
+				 !skb_matches(&slots[i].skb, msg[i], c->len))
+				bad++;
+		}
+	}
+
+	printf("%-14s %5d %10.1f %8.2f %10.1f %8.2f %6.1f%% %6lu\n",
+	       c->name, c->len,
+	       (double)obfs_ns / nobfs, per_byte(obfs_cyc, nobfs, c->len),
+	       nunobfs ? (double)unobfs_ns / nunobfs : 0,
+	       per_byte(unobfs_cyc, nunobfs, c->len),
+	       100.0 * drops / nobfs, bad);
+	return bad != 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n packets] [-w 1|2] [-r rounds] [-p prf] [-c csum] [-f] [-t tailroom]\n"
+		"  -n  packets per case, default 100000\n"
+		"  -w  wire version of --obfs, default 1\n"
+		"  -r  chacha rounds, default 6\n"
+		"  -p  0 chacha, 1 siphash, 2 halfsiphash, 3 aes, default 0\n"
+		"  -c  0 keep, 1 none, 2 sw, default 0\n"
+		"  -f  --padding frag instead of copy\n"
+		"  -t  tailroom of the packets, default 128\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct wg_obfs_ctx ctx = {
+		.wire_ver = XT_WGOBFS_WIRE_V1,
+		.udp_csum = XT_WGOBFS_UDP_CSUM_KEEP,
+		.padding = XT_WGOBFS_PADDING_COPY,
+	};
+	unsigned long npkts = 100000, total = 0;
+	unsigned int rounds = XT_WGOBFS_DEFAULT_ROUNDS;
+	u8 prf = XT_WGOBFS_PRF_CHACHA;
+	u8 key[XT_CHACHA_KEY_SIZE];
+	int tailroom = 128, bad = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:w:r:p:c:ft:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			npkts = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			ctx.wire_ver = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'p':
+			prf = atoi(optarg);
+			break;
+		case 'c':
+			ctx.udp_csum = atoi(optarg);
+			break;
+		case 'f':
+			ctx.padding = XT_WGOBFS_PADDING_FRAG;
+			break;
+		case 't':
+			tailroom = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (ctx.wire_ver < XT_WGOBFS_WIRE_V1 || ctx.wire_ver > XT_WGOBFS_WIRE_V2 ||
+	    !chacha_rounds_valid(rounds) || !wg_prf_valid(prf) ||
+	    ctx.udp_csum > XT_WGOBFS_UDP_CSUM_SW || tailroom < 0 || !npkts) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (kshim_module_init())
+		return 1;
+
+	for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+		key[i] = "mysecretkey"[i % 11];
+	wg_prf_init(&ctx.prf, prf, key, rounds);
+	ctx.stats = wg_obfs_stats_create(NULL, XT_MODE_OBFS);
+	srandom(1);
+
+	printf("wire v%u, prf %u, %u rounds, tailroom %d\n",
+	       ctx.wire_ver, prf, rounds, tailroom);
+	printf("%-14s %5s %10s %8s %10s %8s %7s %6s\n", "type", "len",
+	       "obfs ns", "cyc/B", "unobfs ns", "cyc/B", "drop", "bad");
+	for (i = 0; i < ARRAY_SIZE(cases); i++)
+		bad |= run_case(&cases[i], &ctx, npkts, tailroom);
+
+	printf("head reallocations %lu\n", expands);
+	for (i = 1; i <= MAX_ITERS; i++)
+		total += prn_iters[i];
+	if (total) {
+		printf("padding length hashes per v1 packet\n");
+		for (i = 1; i <= MAX_ITERS; i++)
+			printf("%s%d %9lu %6.2f%%\n", i == MAX_ITERS ? ">=" : "  ",
+			       i, prn_iters[i], 100.0 * prn_iters[i] / total);
+	}
+
+	wg_obfs_stats_destroy(ctx.stats);
+	kshim_module_exit();
+	return bad;
+}
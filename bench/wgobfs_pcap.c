@@ -0,0 +1,602 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Obfuscate or restore the WG packets of a pcap or pcapng capture with
+ * xt_obfs() and xt_unobfs() of the unmodified module source, and report the
+ * throughput and how the packet sizes changed.
+ */
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../src/xt_WGOBFS_main.c"
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 1
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_BOM 0x1a2b3c4d
+#define PCAPNG_MAX_IFS 64
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETHERTYPE_IPV4 0x0800
+#define IP_FRAG_MASK 0x3fff		/* MF and the offset */
+
+#define TAILROOM 128
+#define DELTA_MIN (-64)
+#define DELTA_MAX 64
+/* pages of input already read are dropped every this many bytes */
+#define DROP_BEHIND (64 << 20)
+
+struct pcap_in {
+	const u8 *p, *end;
+	const u8 *base;
+	size_t size, dropped;
+	bool ng, swap;
+	u64 ts_units;			/* per second, classic pcap */
+	unsigned int nifs;
+	u16 if_link[PCAPNG_MAX_IFS];
+	u64 if_units[PCAPNG_MAX_IFS];	/* timestamp units per second */
+	u32 linktype;			/* of the output */
+};
+
+struct pkt {
+	const u8 *data;
+	u32 caplen, origlen;
+	u32 linktype;
+	u64 ts_ns;
+};
+
+struct counters {
+	unsigned long pkts, bytes_in, bytes_out;
+	unsigned long done, dropped, passed, truncated, skipped, other_link;
+	unsigned long delta[DELTA_MAX - DELTA_MIN + 1];
+	unsigned long size_out[6];
+	u64 xform_ns;
+};
+
+static const int size_edges[] = { 128, 256, 512, 1024, 1500 };
+
+static u16 rd16(const struct pcap_in *in, const u8 *p)
+{
+	u16 v;
+
+	memcpy(&v, p, sizeof(v));
+	return in->swap ? __builtin_bswap16(v) : v;
+}
+
+static u32 rd32(const struct pcap_in *in, const u8 *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return in->swap ? __builtin_bswap32(v) : v;
+}
+
+static u16 be16_at(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static u64 units_to_ns(const u64 ts, const u64 units)
+{
+	return ts / units * 1000000000ULL +
+	       ts % units * 1000000000ULL / units;
+}
+
+static int pcap_open(struct pcap_in *in, const char *path)
+{
+	struct stat st;
+	u32 magic;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return -1;
+	}
+	if (st.st_size < 24) {
+		fprintf(stderr, "%s: too short for a capture\n", path);
+		close(fd);
+		return -1;
+	}
+	in->size = st.st_size;
+	in->base = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (in->base == MAP_FAILED) {
+		perror(path);
+		return -1;
+	}
+	madvise((void *)in->base, in->size, MADV_SEQUENTIAL);
+	in->p = in->base;
+	in->end = in->base + in->size;
+
+	memcpy(&magic, in->p, sizeof(magic));
+	if (magic == PCAPNG_SHB) {
+		/* the byte order comes with each section header */
+		in->ng = true;
+		return 0;
+	}
+
+	switch (magic) {
+	case PCAP_MAGIC_US:
+	case PCAP_MAGIC_NS:
+		break;
+	case __builtin_bswap32(PCAP_MAGIC_US):
+	case __builtin_bswap32(PCAP_MAGIC_NS):
+		in->swap = true;
+		break;
+	default:
+		fprintf(stderr, "%s: not a pcap or pcapng file\n", path);
+		return -1;
+	}
+	in->ts_units = rd32(in, in->p) == PCAP_MAGIC_NS ? 1000000000 : 1000000;
+	in->linktype = rd32(in, in->p + 20) & 0xffff;
+	in->p += 24;
+	return 0;
+}
+
+static void pcap_drop_behind(struct pcap_in *in)
+{
+	size_t done = (in->p - in->base) & ~(size_t)(DROP_BEHIND - 1);
+
+	if (done > in->dropped) {
+		madvise((void *)in->base + in->dropped, done - in->dropped,
+			MADV_DONTNEED);
+		in->dropped = done;
+	}
+}
+
+static int pcap_next_classic(struct pcap_in *in, struct pkt *pkt)
+{
+	u32 sec, frac;
+
+	if (in->end - in->p < 16)
+		return 0;
+	sec = rd32(in, in->p);
+	frac = rd32(in, in->p + 4);
+	pkt->caplen = rd32(in, in->p + 8);
+	pkt->origlen = rd32(in, in->p + 12);
+	if (pkt->caplen > in->end - in->p - 16)
+		return -1;
+	pkt->data = in->p + 16;
+	pkt->linktype = in->linktype;
+	pkt->ts_ns = (u64)sec * 1000000000ULL +
+		     units_to_ns(frac, in->ts_units);
+	in->p += 16 + pkt->caplen;
+	return 1;
+}
+
+/* if_tsresol, 10^-v or with the top bit set 2^-v seconds */
+static u64 pcapng_units(const u8 v)
+{
+	u64 units = 1;
+	int i;
+
+	if (v & 0x80)
+		return 1ULL << min(v & 0x7f, 63);
+	for (i = 0; i < min(v, 19); i++)
+		units *= 10;
+	return units;
+}
+
+static void pcapng_idb(struct pcap_in *in, const u8 *b, const u32 len)
+{
+	const u8 *opt = b + 16, *end = b + len - 4;
+	unsigned int i = in->nifs;
+	u16 code, olen;
+
+	if (i == PCAPNG_MAX_IFS)
+		return;
+	in->if_link[i] = rd16(in, b + 8);
+	in->if_units[i] = 1000000;
+	while (end - opt >= 4) {
+		code = rd16(in, opt);
+		olen = rd16(in, opt + 2);
+		if (!code || end - opt - 4 < olen)
+			break;
+		if (code == 9 && olen >= 1)
+			in->if_units[i] = pcapng_units(opt[4]);
+		opt += 4 + ((olen + 3) & ~3);
+	}
+	if (!in->nifs && !in->linktype)
+		in->linktype = in->if_link[i];
+	in->nifs++;
+}
+
+static int pcap_next_ng(struct pcap_in *in, struct pkt *pkt)
+{
+	const u8 *b;
+	u32 type, len, ifid;
+	u64 ts;
+
+	for (;;) {
+		if (in->end - in->p < 12)
+			return 0;
+		b = in->p;
+		memcpy(&type, b, sizeof(type));
+		if (type == PCAPNG_SHB) {
+			u32 bom;
+
+			memcpy(&bom, b + 8, sizeof(bom));
+			in->swap = bom != PCAPNG_BOM;
+			in->nifs = 0;
+		}
+		type = rd32(in, b);
+		len = rd32(in, b + 4);
+		if (len < 12 || len % 4 || len > in->end - b)
+			return -1;
+		in->p += len;
+
+		switch (type) {
+		case PCAPNG_IDB:
+			if (len >= 20)
+				pcapng_idb(in, b, len);
+			break;
+		case PCAPNG_EPB:
+			if (len < 32)
+				return -1;
+			ifid = rd32(in, b + 8);
+			if (ifid >= in->nifs)
+				return -1;
+			ts = (u64)rd32(in, b + 12) << 32 | rd32(in, b + 16);
+			pkt->caplen = rd32(in, b + 20);
+			pkt->origlen = rd32(in, b + 24);
+			if (pkt->caplen > len - 32)
+				return -1;
+			pkt->data = b + 28;
+			pkt->linktype = in->if_link[ifid];
+			pkt->ts_ns = units_to_ns(ts, in->if_units[ifid]);
+			return 1;
+		case PCAPNG_SPB:
+			if (len < 16 || !in->nifs)
+				return -1;
+			pkt->origlen = rd32(in, b + 8);
+			pkt->caplen = min(pkt->origlen, len - 16);
+			pkt->data = b + 12;
+			pkt->linktype = in->if_link[0];
+			pkt->ts_ns = 0;
+			return 1;
+		}
+	}
+}
+
+static int pcap_next(struct pcap_in *in, struct pkt *pkt)
+{
+	pcap_drop_behind(in);
+	return in->ng ? pcap_next_ng(in, pkt) : pcap_next_classic(in, pkt);
+}
+
+/* offset of the IPv4 header, or -1 if the frame does not carry one */
+static int ip_offset(const struct pkt *pkt)
+{
+	const u8 *d = pkt->data;
+	int off, i;
+
+	switch (pkt->linktype) {
+	case LINKTYPE_ETHERNET:
+		off = 12;
+		for (i = 0; i < 2 && pkt->caplen >= off + 2; i++) {
+			if (be16_at(d + off) != 0x8100 &&
+			    be16_at(d + off) != 0x88a8)
+				break;
+			off += 4;
+		}
+		if (pkt->caplen < off + 2 ||
+		    be16_at(d + off) != ETHERTYPE_IPV4)
+			return -1;
+		return off + 2;
+	case LINKTYPE_LINUX_SLL:
+		if (pkt->caplen < 16 || be16_at(d + 14) != ETHERTYPE_IPV4)
+			return -1;
+		return 16;
+	case LINKTYPE_LINUX_SLL2:
+		if (pkt->caplen < 20 || be16_at(d) != ETHERTYPE_IPV4)
+			return -1;
+		return 20;
+	case LINKTYPE_RAW:
+	case LINKTYPE_IPV4:
+		return 0;
+	}
+	return -1;
+}
+
+/* is the IPv4 packet at @ip, @len bytes long, a whole UDP one for @port */
+static bool ip_is_target(const u8 *ip, const u32 len, const int port)
+{
+	const struct iphdr *iph = (const void *)ip;
+	const struct udphdr *udph = (const void *)(ip + KSHIM_IP_HLEN);
+
+	/* the shim only knows headers without options */
+	if (len < KSHIM_IP_HLEN + sizeof(struct udphdr) || iph->version != 4 ||
+	    iph->ihl != KSHIM_IP_HLEN / 4 || iph->protocol != IPPROTO_UDP ||
+	    ntohs(iph->tot_len) != len ||
+	    (iph->frag_off & htons(IP_FRAG_MASK)) ||
+	    ntohs(udph->len) != len - KSHIM_IP_HLEN)
+		return false;
+	return port < 0 || ntohs(udph->source) == port ||
+	       ntohs(udph->dest) == port;
+}
+
+static void pcap_write_header(FILE *out, const u32 linktype)
+{
+	const u32 hdr[6] = { PCAP_MAGIC_NS, 2 | 4 << 16, 0, 0, 262144,
+			     linktype };
+
+	fwrite(hdr, sizeof(hdr), 1, out);
+}
+
+static void pcap_write(FILE *out, const struct pkt *pkt, const u8 *l2,
+		       const u32 l2len, const u8 *ip, const u32 iplen,
+		       const u32 origlen)
+{
+	u32 hdr[4];
+
+	if (!out)
+		return;
+	hdr[0] = pkt->ts_ns / 1000000000ULL;
+	hdr[1] = pkt->ts_ns % 1000000000ULL;
+	hdr[2] = l2len + iplen;
+	hdr[3] = origlen;
+	fwrite(hdr, sizeof(hdr), 1, out);
+	fwrite(l2, l2len, 1, out);
+	fwrite(ip, iplen, 1, out);
+}
+
+static void count_out(struct counters *cnt, const u32 len)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(size_edges) && len > size_edges[i]; i++)
+		;
+	cnt->size_out[i]++;
+	cnt->bytes_out += len;
+}
+
+static void transform(const struct pkt *pkt, struct sk_buff *skb,
+		      const struct wg_obfs_ctx *ctx, const u8 mode,
+		      const int port, FILE *out, struct counters *cnt)
+{
+	int off = ip_offset(pkt);
+	u32 iplen;
+	unsigned int ret;
+	u64 t0;
+
+	cnt->pkts++;
+	cnt->bytes_in += pkt->caplen;
+
+	if (off < 0) {
+		cnt->skipped++;
+		goto pass;
+	}
+	/* the IP length leaves out the Ethernet trailer */
+	iplen = pkt->caplen - off;
+	if (iplen >= 4)
+		iplen = min_t(u32, iplen, be16_at(pkt->data + off + 2));
+	if (pkt->caplen < pkt->origlen) {
+		cnt->truncated++;
+		goto pass;
+	}
+	if (!ip_is_target(pkt->data + off, iplen, port)) {
+		cnt->skipped++;
+		goto pass;
+	}
+
+	if (skb->end < iplen + TAILROOM) {
+		free(skb->head);
+		skb->head = malloc(iplen + TAILROOM);
+		skb->end = iplen + TAILROOM;
+	}
+	skb->data = skb->head;
+	skb->tail = skb->len = iplen;
+	skb->data_len = 0;
+	skb->protocol = htons(ETHERTYPE_IPV4);
+	skb->ip_summed = CHECKSUM_NONE;
+	memcpy(skb->data, pkt->data + off, iplen);
+
+	t0 = local_clock();
+	ret = mode == XT_MODE_OBFS ? xt_obfs(skb, ctx) : xt_unobfs(skb, ctx);
+	cnt->xform_ns += local_clock() - t0;
+
+	if (ret == NF_DROP) {
+		cnt->dropped++;
+		return;
+	}
+	cnt->done++;
+	cnt->delta[max(min((int)skb->len - (int)iplen, DELTA_MAX), DELTA_MIN) -
+		   DELTA_MIN]++;
+	count_out(cnt, off + skb->len);
+	pcap_write(out, pkt, pkt->data, off, skb->data, skb->len,
+		   off + skb->len);
+	return;
+
+pass:
+	cnt->passed++;
+	count_out(cnt, pkt->caplen);
+	pcap_write(out, pkt, pkt->data, pkt->caplen, NULL, 0, pkt->origlen);
+}
+
+static void report(const struct counters *cnt, const double secs)
+{
+	int i;
+
+	printf("packets %lu, transformed %lu, dropped %lu, passed %lu (truncated %lu, not WG %lu), other link type %lu\n",
+	       cnt->pkts, cnt->done, cnt->dropped, cnt->passed,
+	       cnt->truncated, cnt->skipped, cnt->other_link);
+	printf("bytes in %lu, out %lu, %+.2f%%\n", cnt->bytes_in,
+	       cnt->bytes_out,
+	       cnt->bytes_in ?
+	       100.0 * ((double)cnt->bytes_out - cnt->bytes_in) / cnt->bytes_in :
+	       0);
+	printf("%.3f s, %.1f MB/s, %.0f pps, %.1f ns per transform\n", secs,
+	       secs ? cnt->bytes_in / secs / 1e6 : 0,
+	       secs ? cnt->pkts / secs : 0,
+	       cnt->done + cnt->dropped ?
+	       (double)cnt->xform_ns / (cnt->done + cnt->dropped) : 0);
+
+	if (cnt->done) {
+		printf("length change of transformed packets\n");
+		for (i = 0; i < ARRAY_SIZE(cnt->delta); i++) {
+			if (!cnt->delta[i])
+				continue;
+			printf("%s%+4d %9lu %6.2f%%\n",
+			       i == 0 ? "<=" :
+			       i == ARRAY_SIZE(cnt->delta) - 1 ? ">=" : "  ",
+			       i + DELTA_MIN, cnt->delta[i],
+			       100.0 * cnt->delta[i] / cnt->done);
+		}
+	}
+
+	if (cnt->done + cnt->passed) {
+		printf("size of packets written\n");
+		for (i = 0; i < ARRAY_SIZE(cnt->size_out); i++) {
+			if (i < ARRAY_SIZE(size_edges))
+				printf("<=%-5d", size_edges[i]);
+			else
+				printf(" >%-5d", size_edges[i - 1]);
+			printf(" %9lu %6.2f%%\n", cnt->size_out[i],
+			       100.0 * cnt->size_out[i] /
+			       (cnt->done + cnt->passed));
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -k key -o|-u [-p port] [-w 1|2] [-r rounds] [-P prf] [-c csum] [-f] in [out]\n"
+		"  -k  shared key, as --key\n"
+		"  -o  obfuscate, as --obfs\n"
+		"  -u  restore, as --unobfs\n"
+		"  -p  only UDP packets from or to this port, default all\n"
+		"  -w  wire version of -o, default 1\n"
+		"  -r  chacha rounds, default 6\n"
+		"  -P  0 chacha, 1 siphash, 2 halfsiphash, 3 aes, default 0\n"
+		"  -c  0 keep, 1 none, 2 sw, default 0\n"
+		"  -f  --padding frag instead of copy\n"
+		"in is pcap or pcapng, out is pcap with nanosecond timestamps\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct wg_obfs_ctx ctx = {
+		.wire_ver = XT_WGOBFS_WIRE_V1,
+		.udp_csum = XT_WGOBFS_UDP_CSUM_KEEP,
+		.padding = XT_WGOBFS_PADDING_COPY,
+	};
+	unsigned int rounds = XT_WGOBFS_DEFAULT_ROUNDS;
+	u8 prf = XT_WGOBFS_PRF_CHACHA;
+	int mode = -1;
+	u8 key[XT_CHACHA_KEY_SIZE];
+	const char *keystr = NULL;
+	struct pcap_in in = {};
+	struct counters cnt = {};
+	struct sk_buff skb = {};
+	struct pkt pkt;
+	FILE *out = NULL;
+	int port = -1, opt, ret, i;
+	u64 t0;
+
+	while ((opt = getopt(argc, argv, "k:oup:w:r:P:c:fh")) != -1) {
+		switch (opt) {
+		case 'k':
+			keystr = optarg;
+			break;
+		case 'o':
+			mode = XT_MODE_OBFS;
+			break;
+		case 'u':
+			mode = XT_MODE_UNOBFS;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'w':
+			ctx.wire_ver = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'P':
+			prf = atoi(optarg);
+			break;
+		case 'c':
+			ctx.udp_csum = atoi(optarg);
+			break;
+		case 'f':
+			ctx.padding = XT_WGOBFS_PADDING_FRAG;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (!keystr || !*keystr || strlen(keystr) > XT_WGOBFS_MAX_KEY_SIZE ||
+	    mode < 0 || optind >= argc || argc - optind > 2 || port > 65535 ||
+	    ctx.wire_ver < XT_WGOBFS_WIRE_V1 || ctx.wire_ver > XT_WGOBFS_WIRE_V2 ||
+	    !chacha_rounds_valid(rounds) || !wg_prf_valid(prf) ||
+	    ctx.udp_csum > XT_WGOBFS_UDP_CSUM_SW) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (pcap_open(&in, argv[optind]))
+		return 1;
+
+	if (argc - optind == 2) {
+		out = fopen(argv[optind + 1], "w");
+		if (!out) {
+			perror(argv[optind + 1]);
+			return 1;
+		}
+		setvbuf(out, NULL, _IOFBF, 1 << 20);
+	}
+
+	if (kshim_module_init())
+		return 1;
+
+	/* as libxt_WGOBFS, the key is repeated up to 32 bytes */
+	for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+		key[i] = keystr[i % strlen(keystr)];
+	wg_prf_init(&ctx.prf, prf, key, rounds);
+	ctx.stats = wg_obfs_stats_create(NULL, mode);
+
+	t0 = local_clock();
+	while ((ret = pcap_next(&in, &pkt)) > 0) {
+		if (out && !ftell(out))
+			pcap_write_header(out, in.linktype);
+		/* a pcap file has one link type, the others are left out */
+		if (pkt.linktype != in.linktype) {
+			cnt.pkts++;
+			cnt.other_link++;
+			continue;
+		}
+		transform(&pkt, &skb, &ctx, mode, port, out, &cnt);
+	}
+	if (ret < 0)
+		fprintf(stderr, "%s: malformed at offset %zu, stopped\n",
+			argv[optind], (size_t)(in.p - in.base));
+
+	if (out && !ftell(out))
+		pcap_write_header(out, in.linktype);
+	if (out && fclose(out)) {
+		perror(argv[optind + 1]);
+		ret = -1;
+	}
+	report(&cnt, (local_clock() - t0) / 1e9);
+
+	free(skb.head);
+	wg_obfs_stats_destroy(ctx.stats);
+	kshim_module_exit();
+	munmap((void *)in.base, in.size);
+	return ret < 0;
+}
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Send or count UDP datagrams that look like WireGuard messages, for
+ * netns.sh. The sender runs flat out for a given time, with sendmmsg().
+ *
+ *   wgtraffic send -d addr [-p port] [-s sport] [-t secs] [-m mix]
+ *   wgtraffic recv [-p port] [-t secs]
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define BATCH 64
+#define MAX_LEN 1456	/* data message of a full 1420 bytes WG MTU */
+
+enum {
+	WG_HANDSHAKE_INIT = 1,
+	WG_HANDSHAKE_RESP = 2,
+	WG_COOKIE = 3,
+	WG_DATA = 4
+};
+
+/* Every BATCH messages of the IMIX, the data sizes are the 7:4:1 simple
+ * IMIX of 40, 576 and 1420 bytes inner packets, padded to 16 bytes by WG
+ * and with its 32 bytes of header and tag.
+ */
+static const struct {
+	uint8_t type;
+	uint16_t len;
+	int count;
+} imix[] = {
+	{ WG_HANDSHAKE_INIT, 148, 1 },
+	{ WG_HANDSHAKE_RESP, 92, 1 },
+	{ WG_DATA, 32, 2 },		/* keepalive */
+	{ WG_DATA, 80, 35 },
+	{ WG_DATA, 608, 20 },
+	{ WG_DATA, MAX_LEN, 5 }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void msg_fill(uint8_t *msg, const uint8_t type, const int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		msg[i] = random();
+	msg[0] = type;
+	msg[1] = msg[2] = msg[3] = 0;
+	/* no cookie MAC */
+	if (type == WG_HANDSHAKE_INIT || type == WG_HANDSHAKE_RESP)
+		memset(msg + len - 16, 0, 16);
+}
+
+/* mix is imix, init, resp, cookie, keepalive or a data message length */
+static int batch_fill(uint8_t msgs[BATCH][MAX_LEN], int lens[BATCH],
+		      const char *mix)
+{
+	int i, j, n = 0, len;
+
+	if (!strcmp(mix, "imix")) {
+		for (i = 0; i < (int)ARRAY_SIZE(imix); i++) {
+			for (j = 0; j < imix[i].count; j++, n++) {
+				msg_fill(msgs[n], imix[i].type, imix[i].len);
+				lens[n] = imix[i].len;
+			}
+		}
+		return 0;
+	}
+
+	for (n = 0; n < BATCH; n++) {
+		if (!strcmp(mix, "init"))
+			msg_fill(msgs[n], WG_HANDSHAKE_INIT, lens[n] = 148);
+		else if (!strcmp(mix, "resp"))
+			msg_fill(msgs[n], WG_HANDSHAKE_RESP, lens[n] = 92);
+		else if (!strcmp(mix, "cookie"))
+			msg_fill(msgs[n], WG_COOKIE, lens[n] = 64);
+		else if (!strcmp(mix, "keepalive"))
+			msg_fill(msgs[n], WG_DATA, lens[n] = 32);
+		else {
+			len = atoi(mix);
+			if (len < 32 || len > MAX_LEN || len % 16)
+				return -1;
+			msg_fill(msgs[n], WG_DATA, lens[n] = len);
+		}
+	}
+	return 0;
+}
+
+static int udp_socket(const int port)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+	};
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0 || (port && bind(fd, (struct sockaddr *)&sin, sizeof(sin)))) {
+		perror("socket");
+		exit(1);
+	}
+
+	return fd;
+}
+
+static int do_send(const char *dst, const int port, const int sport,
+		   const double secs, const char *mix)
+{
+	static uint8_t msgs[BATCH][MAX_LEN];
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+	};
+	struct mmsghdr mm[BATCH];
+	struct iovec iov[BATCH];
+	unsigned long pkts = 0, bytes = 0;
+	int lens[BATCH], fd, i, n;
+	double t0, t;
+
+	if (inet_pton(AF_INET, dst, &sin.sin_addr) != 1 ||
+	    batch_fill(msgs, lens, mix)) {
+		fprintf(stderr, "wgtraffic: bad address or mix\n");
+		return 2;
+	}
+
+	fd = udp_socket(sport);
+	memset(mm, 0, sizeof(mm));
+	for (i = 0; i < BATCH; i++) {
+		iov[i].iov_base = msgs[i];
+		iov[i].iov_len = lens[i];
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+		mm[i].msg_hdr.msg_name = &sin;
+		mm[i].msg_hdr.msg_namelen = sizeof(sin);
+	}
+
+	t0 = t = now();
+	while (t - t0 < secs) {
+		n = sendmmsg(fd, mm, BATCH, 0);
+		if (n < 0 && errno != ENOBUFS && errno != EAGAIN) {
+			perror("sendmmsg");
+			return 1;
+		}
+
+		for (i = 0; i < n; i++) {
+			pkts++;
+			bytes += lens[i];
+		}
+		t = now();
+	}
+
+	printf("sent %lu pkts %lu bytes %.3f s\n", pkts, bytes, t - t0);
+	return 0;
+}
+
+/* the rate is over the time between the first and the last datagram */
+static int do_recv(const int port, const double secs)
+{
+	static uint8_t bufs[BATCH][2048];
+	struct timeval tv = { .tv_usec = 100000 };
+	struct mmsghdr mm[BATCH];
+	struct iovec iov[BATCH];
+	unsigned long pkts = 0, bytes = 0;
+	double t0 = 0, t1 = 0, start;
+	int fd, i, n;
+
+	fd = udp_socket(port);
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	memset(mm, 0, sizeof(mm));
+	for (i = 0; i < BATCH; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = sizeof(bufs[i]);
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	start = now();
+	while (now() - start < secs) {
+		n = recvmmsg(fd, mm, BATCH, 0, NULL);
+		if (n <= 0)
+			continue;
+
+		t1 = now();
+		if (!pkts)
+			t0 = t1;
+		for (i = 0; i < n; i++) {
+			pkts++;
+			bytes += mm[i].msg_len;
+		}
+	}
+
+	printf("recv %lu pkts %lu bytes %.3f s\n", pkts, bytes, t1 - t0);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wgtraffic send -d addr [-p port] [-s sport] [-t secs] [-m mix]\n"
+		"       wgtraffic recv [-p port] [-t secs]\n"
+		"  mix is imix, init, resp, cookie, keepalive or a data length,\n"
+		"  default imix\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *dst = NULL, *mix = "imix";
+	int port = 6789, sport = 0, opt;
+	double secs = 5;
+
+	if (argc < 2) {
+		usage();
+		return 2;
+	}
+
+	optind = 2;
+	while ((opt = getopt(argc, argv, "d:p:s:t:m:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dst = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			sport = atoi(optarg);
+			break;
+		case 't':
+			secs = atof(optarg);
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	srandom(getpid());
+	if (!strcmp(argv[1], "send") && dst)
+		return do_send(dst, port, sport, secs, mix);
+	if (!strcmp(argv[1], "recv"))
+		return do_recv(port, secs);
+
+	usage();
+	return 2;
+}
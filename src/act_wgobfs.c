@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * The tc action "wgobfs". It runs the transform of the WGOBFS target from a
+ * clsact qdisc, before or after netfilter, so the tunnel traffic needs
+ * neither conntrack nor an iptables rule. Each action has the options of
+ * revision 1, passed as TCA_WGOBFS_* attributes, and its own counters.
+ *
+ * tc loads it as act_wgobfs.ko, apart from xt_WGOBFS.ko whose transform it
+ * calls, so netfilter users do not need the tc action code.
+ */
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/rtnetlink.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+#include <net/act_api.h>
+#include "obfs.h"
+#include "tc_wgobfs.h"
+
+/* the action uses the init API of 5.15 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0)
+
+struct tcf_wgobfs_params {
+	struct xt_wg_obfs_info_v1 info;
+};
+
+struct tcf_wgobfs {
+	struct tc_action common;
+	struct tcf_wgobfs_params __rcu *params;
+};
+
+#define to_wgobfs(a) ((struct tcf_wgobfs *)a)
+
+static struct tc_action_ops act_wgobfs_ops;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,1,0)
+#define wgobfs_net_id act_wgobfs_ops.net_id
+#else
+static unsigned int wgobfs_net_id;
+#endif
+
+static const struct nla_policy wgobfs_policy[TCA_WGOBFS_MAX + 1] = {
+	[TCA_WGOBFS_PARMS]	= { .len = sizeof(struct tc_wgobfs) },
+	[TCA_WGOBFS_KEY]	= { .type = NLA_STRING,
+				    .len = XT_WGOBFS_MAX_KEY_SIZE },
+	[TCA_WGOBFS_MODE]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_WIRE_VER]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_ROUNDS]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_PRF]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_UDP_CSUM]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_PADDING]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_HS_RATE]	= { .type = NLA_U32 },
+	[TCA_WGOBFS_HS_BURST]	= { .type = NLA_U32 },
+};
+
+/* tc runs with BH disabled, on egress skb->data is the MAC header */
+static int tcf_wgobfs_act(struct sk_buff *skb, const struct tc_action *a,
+			  struct tcf_result *res)
+{
+	struct tcf_wgobfs *d = to_wgobfs(a);
+	const struct tcf_wgobfs_params *p;
+	const int nhoff = skb_network_offset(skb);
+	unsigned int verdict;
+	int action;
+
+	tcf_lastuse_update(&d->tcf_tm);
+	tcf_action_update_bstats(&d->common, skb);
+
+	action = READ_ONCE(d->tcf_action);
+	if (unlikely(action == TC_ACT_SHOT))
+		goto drop;
+
+	if (!wg_obfs_skb_udp4(skb, nhoff))
+		return action;
+
+	p = rcu_dereference_bh(d->params);
+	__skb_pull(skb, nhoff);
+	verdict = wg_obfs_target(skb, p->info.mode, p->info.ctx);
+	__skb_push(skb, nhoff);
+	if (verdict == NF_DROP)
+		goto drop;
+
+	return action;
+
+drop:
+	tcf_action_inc_drop_qstats(&d->common);
+	return TC_ACT_SHOT;
+}
+
+static int tcf_wgobfs_get_u8(const struct nlattr *attr, u8 *v)
+{
+	u32 n;
+
+	if (!attr)
+		return 0;
+
+	n = nla_get_u32(attr);
+	if (n > U8_MAX)
+		return -ERANGE;
+
+	*v = n;
+	return 0;
+}
+
+static int tcf_wgobfs_parse(struct nlattr **tb,
+			    struct xt_wg_obfs_info_v1 *info,
+			    struct netlink_ext_ack *extack)
+{
+	int ret;
+
+	if (!tb[TCA_WGOBFS_KEY] || !tb[TCA_WGOBFS_MODE]) {
+		NL_SET_ERR_MSG(extack, "wgobfs needs a key and a mode");
+		return -EINVAL;
+	}
+
+	wg_obfs_info_init(info);
+	ret = wg_obfs_info_set_key(info, nla_data(tb[TCA_WGOBFS_KEY]),
+				   strnlen(nla_data(tb[TCA_WGOBFS_KEY]),
+					   nla_len(tb[TCA_WGOBFS_KEY])));
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_MODE], &info->mode);
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_WIRE_VER],
+					&info->wire_ver);
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_ROUNDS], &info->rounds);
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_PRF], &info->prf);
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_UDP_CSUM],
+					&info->udp_csum);
+	if (!ret)
+		ret = tcf_wgobfs_get_u8(tb[TCA_WGOBFS_PADDING],
+					&info->padding);
+	if (ret)
+		return ret;
+
+	if (tb[TCA_WGOBFS_HS_RATE])
+		info->hs_rate = nla_get_u32(tb[TCA_WGOBFS_HS_RATE]);
+	if (tb[TCA_WGOBFS_HS_BURST])
+		info->hs_burst = nla_get_u32(tb[TCA_WGOBFS_HS_BURST]);
+
+	return wg_obfs_info_check(info);
+}
+
+static int tcf_wgobfs_init(struct net *net, struct nlattr *nla,
+			   struct nlattr *est, struct tc_action **a,
+			   struct tcf_proto *tp, u32 flags,
+			   struct netlink_ext_ack *extack)
+{
+	struct tc_action_net *tn = net_generic(net, wgobfs_net_id);
+	bool bind = flags & TCA_ACT_FLAGS_BIND;
+	struct tcf_wgobfs_params *p, *p_old;
+	struct nlattr *tb[TCA_WGOBFS_MAX + 1];
+	struct tcf_chain *goto_ch = NULL;
+	struct tc_wgobfs *parm;
+	struct tcf_wgobfs *d;
+	bool exists = false;
+	int ret = 0, err;
+	u32 index;
+
+	if (!nla)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_WGOBFS_MAX, nla, wgobfs_policy, extack);
+	if (err < 0)
+		return err;
+
+	if (!tb[TCA_WGOBFS_PARMS])
+		return -EINVAL;
+
+	parm = nla_data(tb[TCA_WGOBFS_PARMS]);
+	index = parm->index;
+	err = tcf_idr_check_alloc(tn, &index, a, bind);
+	if (err < 0)
+		return err;
+	exists = err;
+	if (exists && bind)
+		return 0;
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p) {
+		err = -ENOMEM;
+		goto err_params;
+	}
+
+	err = tcf_wgobfs_parse(tb, &p->info, extack);
+	if (!err)
+		err = wg_obfs_ctx_create(net, &p->info);
+	if (err) {
+		kfree(p);
+		goto err_params;
+	}
+
+	if (!exists) {
+		err = tcf_idr_create(tn, index, est, a, &act_wgobfs_ops, bind,
+				     true, flags);
+		if (err) {
+			tcf_idr_cleanup(tn, index);
+			goto err_free;
+		}
+		ret = ACT_P_CREATED;
+	} else if (!(flags & TCA_ACT_FLAGS_REPLACE)) {
+		err = -EEXIST;
+		goto err_release;
+	}
+
+	err = tcf_action_check_ctrlact(parm->action, tp, &goto_ch, extack);
+	if (err < 0)
+		goto err_release;
+
+	d = to_wgobfs(*a);
+	spin_lock_bh(&d->tcf_lock);
+	goto_ch = tcf_action_set_ctrlact(*a, parm->action, goto_ch);
+	p_old = rcu_dereference_protected(d->params,
+					  lockdep_is_held(&d->tcf_lock));
+	rcu_assign_pointer(d->params, p);
+	spin_unlock_bh(&d->tcf_lock);
+
+	/* the counters of the old rule go away with it, and their mutex
+	 * rules out call_rcu()
+	 */
+	if (p_old) {
+		synchronize_rcu();
+		wg_obfs_ctx_destroy(p_old->info.ctx);
+		kfree(p_old);
+	}
+	if (goto_ch)
+		tcf_chain_put_by_act(goto_ch);
+
+	return ret;
+
+err_release:
+	tcf_idr_release(*a, bind);
+err_free:
+	wg_obfs_ctx_destroy(p->info.ctx);
+	kfree(p);
+	return err;
+
+err_params:
+	if (exists)
+		tcf_idr_release(*a, bind);
+	else
+		tcf_idr_cleanup(tn, index);
+	return err;
+}
+
+/* the filters holding the action are freed after a grace period, no packet
+ * is left in tcf_wgobfs_act()
+ */
+static void tcf_wgobfs_cleanup(struct tc_action *a)
+{
+	struct tcf_wgobfs *d = to_wgobfs(a);
+	struct tcf_wgobfs_params *p;
+
+	p = rcu_dereference_protected(d->params, 1);
+	if (p) {
+		wg_obfs_ctx_destroy(p->info.ctx);
+		kfree(p);
+	}
+}
+
+static int tcf_wgobfs_dump(struct sk_buff *skb, struct tc_action *a,
+			   int bind, int ref)
+{
+	unsigned char *b = skb_tail_pointer(skb);
+	struct tcf_wgobfs *d = to_wgobfs(a);
+	const struct xt_wg_obfs_info_v1 *info;
+	const struct tcf_wgobfs_params *p;
+	struct tc_wgobfs opt = {
+		.index   = d->tcf_index,
+		.refcnt  = refcount_read(&d->tcf_refcnt) - ref,
+		.bindcnt = atomic_read(&d->tcf_bindcnt) - bind,
+	};
+	struct tcf_t t;
+
+	spin_lock_bh(&d->tcf_lock);
+	opt.action = d->tcf_action;
+	p = rcu_dereference_protected(d->params,
+				      lockdep_is_held(&d->tcf_lock));
+	info = &p->info;
+	if (nla_put(skb, TCA_WGOBFS_PARMS, sizeof(opt), &opt) ||
+	    nla_put_string(skb, TCA_WGOBFS_KEY, info->key) ||
+	    nla_put_u32(skb, TCA_WGOBFS_MODE, info->mode) ||
+	    nla_put_u32(skb, TCA_WGOBFS_WIRE_VER, info->wire_ver) ||
+	    nla_put_u32(skb, TCA_WGOBFS_ROUNDS, info->rounds) ||
+	    nla_put_u32(skb, TCA_WGOBFS_PRF, info->prf) ||
+	    nla_put_u32(skb, TCA_WGOBFS_UDP_CSUM, info->udp_csum) ||
+	    nla_put_u32(skb, TCA_WGOBFS_PADDING, info->padding) ||
+	    nla_put_u32(skb, TCA_WGOBFS_ID, info->id))
+		goto nla_put_failure;
+
+	if (info->hs_rate &&
+	    (nla_put_u32(skb, TCA_WGOBFS_HS_RATE, info->hs_rate) ||
+	     nla_put_u32(skb, TCA_WGOBFS_HS_BURST, info->hs_burst)))
+		goto nla_put_failure;
+
+	tcf_tm_dump(&t, &d->tcf_tm);
+	if (nla_put_64bit(skb, TCA_WGOBFS_TM, sizeof(t), &t, TCA_WGOBFS_PAD))
+		goto nla_put_failure;
+	spin_unlock_bh(&d->tcf_lock);
+
+	return skb->len;
+
+nla_put_failure:
+	spin_unlock_bh(&d->tcf_lock);
+	nlmsg_trim(skb, b);
+	return -1;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,1,0)
+static int tcf_wgobfs_walker(struct net *net, struct sk_buff *skb,
+			     struct netlink_callback *cb, int type,
+			     const struct tc_action_ops *ops,
+			     struct netlink_ext_ack *extack)
+{
+	struct tc_action_net *tn = net_generic(net, wgobfs_net_id);
+
+	return tcf_generic_walker(tn, skb, cb, type, ops, extack);
+}
+
+static int tcf_wgobfs_search(struct net *net, struct tc_action **a, u32 index)
+{
+	struct tc_action_net *tn = net_generic(net, wgobfs_net_id);
+
+	return tcf_idr_search(tn, a, index);
+}
+#endif
+
+static struct tc_action_ops act_wgobfs_ops = {
+	.kind		= "wgobfs",
+	.id		= TCA_ID_WGOBFS,
+	.owner		= THIS_MODULE,
+	.act		= tcf_wgobfs_act,
+	.dump		= tcf_wgobfs_dump,
+	.init		= tcf_wgobfs_init,
+	.cleanup	= tcf_wgobfs_cleanup,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,1,0)
+	.walk		= tcf_wgobfs_walker,
+	.lookup		= tcf_wgobfs_search,
+#endif
+	.size		= sizeof(struct tcf_wgobfs),
+};
+
+static __net_init int wgobfs_init_net(struct net *net)
+{
+	struct tc_action_net *tn = net_generic(net, wgobfs_net_id);
+
+	return tc_action_net_init(net, tn, &act_wgobfs_ops);
+}
+
+static void __net_exit wgobfs_exit_net(struct list_head *net_list)
+{
+	tc_action_net_exit(net_list, wgobfs_net_id);
+}
+
+static struct pernet_operations wgobfs_net_ops = {
+	.init		= wgobfs_init_net,
+	.exit_batch	= wgobfs_exit_net,
+	.id		= &wgobfs_net_id,
+	.size		= sizeof(struct tc_action_net),
+};
+
+static int __init act_wgobfs_module_init(void)
+{
+	return tcf_register_action(&act_wgobfs_ops, &wgobfs_net_ops);
+}
+
+static void __exit act_wgobfs_module_exit(void)
+{
+	tcf_unregister_action(&act_wgobfs_ops, &wgobfs_net_ops);
+}
+
+module_init(act_wgobfs_module_init);
+module_exit(act_wgobfs_module_exit);
+
+#endif /* >= 5.15 */
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("tc obfuscation action for WireGuard");
+MODULE_AUTHOR("Wei Chen <weichen302@gmail.com>");
+MODULE_VERSION("0.5");
@@ -2,81 +2,45 @@
 /*
  * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
  *
- * modified from Jason A. Donenfeld's wireguard, simd is not included
+ * modified from Jason A. Donenfeld's wireguard, the SIMD backends are in
+ * chacha_vec.h, the MIPS32r2 rounds in chacha_mips.h
  */
-#include "chacha.h"
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include "chacha_impl.h"
 
-enum chacha20_constants { /* expand 32-byte k */
-	CHACHA20_CONSTANT_EXPA = 0x61707865U,
-	CHACHA20_CONSTANT_ND_3 = 0x3320646eU,
-	CHACHA20_CONSTANT_2_BY = 0x79622d32U,
-	CHACHA20_CONSTANT_TE_K = 0x6b206574U
-};
-
-struct chacha20_ctx {
-	union {
-		u32 state[16];
-		struct {
-			u32 constant[4];
-			u32 key[8];
-			u32 counter[4];
-		};
-	};
-};
+/* the scalar rounds are chosen at build time */
+#ifdef CONFIG_CPU_MIPS32_R2
+#include "chacha_mips.h"
+#define CHACHA_SCALAR "mips32r2"
+#define CHACHA_PERMUTE(x, rounds) chacha_permute_mips(x, rounds)
+#else
+#define CHACHA_SCALAR "generic"
+#define CHACHA_PERMUTE(x, rounds) CHACHA_ROUNDS(x, rounds)
+#endif
 
-static inline void chacha20_init(struct chacha20_ctx *ctx,
-                                 const u8 key[CHACHA20_KEY_SIZE],
-                                 const u8 in[CHACHA_INPUT_SIZE])
+/* Set up the constant and key words. The key is stored behind the mode byte
+ * and the key string of the rule, it is at an odd offset. Only parse it once
+ * when the rule is inserted.
+ */
+void chacha_init_state(struct chacha_state *st,
+                       const u8 key[CHACHA20_KEY_SIZE], unsigned int rounds)
 {
-	ctx->constant[0] = CHACHA20_CONSTANT_EXPA;
-	ctx->constant[1] = CHACHA20_CONSTANT_ND_3;
-	ctx->constant[2] = CHACHA20_CONSTANT_2_BY;
-	ctx->constant[3] = CHACHA20_CONSTANT_TE_K;
-	ctx->key[0] = get_unaligned_le32(key + 0);
-	ctx->key[1] = get_unaligned_le32(key + 4);
-	ctx->key[2] = get_unaligned_le32(key + 8);
-	ctx->key[3] = get_unaligned_le32(key + 12);
-	ctx->key[4] = get_unaligned_le32(key + 16);
-	ctx->key[5] = get_unaligned_le32(key + 20);
-	ctx->key[6] = get_unaligned_le32(key + 24);
-	ctx->key[7] = get_unaligned_le32(key + 28);
-	ctx->counter[0] = get_unaligned_le32(in + 0);
-	ctx->counter[1] = get_unaligned_le32(in + 4);
-	ctx->counter[2] = get_unaligned_le32(in + 8);
-	ctx->counter[3] = get_unaligned_le32(in + 12);
-}
+	u32 *x = st->state;
+	int i;
+
+	x[CHACHA_CONSTANT_WORD + 0] = CHACHA20_CONSTANT_EXPA;
+	x[CHACHA_CONSTANT_WORD + 1] = CHACHA20_CONSTANT_ND_3;
+	x[CHACHA_CONSTANT_WORD + 2] = CHACHA20_CONSTANT_2_BY;
+	x[CHACHA_CONSTANT_WORD + 3] = CHACHA20_CONSTANT_TE_K;
+	for (i = 0; i < CHACHA20_KEY_WORDS; i++)
+		x[CHACHA_KEY_WORD + i] = get_unaligned_le32(key + i * 4);
 
-#define QUARTER_ROUND(x, a, b, c, d) ( \
-	x[a] += x[b], \
-	x[d] = rol32((x[d] ^ x[a]), 16), \
-	x[c] += x[d], \
-	x[b] = rol32((x[b] ^ x[c]), 12), \
-	x[a] += x[b], \
-	x[d] = rol32((x[d] ^ x[a]), 8), \
-	x[c] += x[d], \
-	x[b] = rol32((x[b] ^ x[c]), 7) \
-)
-
-#define C(i, j) (i * 4 + j)
-
-#define DOUBLE_ROUND(x) ( \
-	/* Column Round */ \
-	QUARTER_ROUND(x, C(0, 0), C(1, 0), C(2, 0), C(3, 0)), \
-	QUARTER_ROUND(x, C(0, 1), C(1, 1), C(2, 1), C(3, 1)), \
-	QUARTER_ROUND(x, C(0, 2), C(1, 2), C(2, 2), C(3, 2)), \
-	QUARTER_ROUND(x, C(0, 3), C(1, 3), C(2, 3), C(3, 3)), \
-	/* Diagonal Round */ \
-	QUARTER_ROUND(x, C(0, 0), C(1, 1), C(2, 2), C(3, 3)), \
-	QUARTER_ROUND(x, C(0, 1), C(1, 2), C(2, 3), C(3, 0)), \
-	QUARTER_ROUND(x, C(0, 2), C(1, 3), C(2, 0), C(3, 1)), \
-	QUARTER_ROUND(x, C(0, 3), C(1, 0), C(2, 1), C(3, 2)) \
-)
-
-#define SIX_ROUNDS(x) ( \
-	DOUBLE_ROUND(x), \
-	DOUBLE_ROUND(x), \
-	DOUBLE_ROUND(x) \
-)
+	for (i = 0; i < CHACHA_NONCE_WORDS; i++)
+		x[CHACHA_NONCE_WORD + i] = 0;
+
+	st->rounds = rounds;
+}
 
 /* Hash 16 bytes input into 32 bytes hash. Only use 32 bytes of 64 bytes chacha
  * output.
@@ -87,21 +51,277 @@ static inline void chacha20_init(struct chacha20_ctx *ctx,
  *
  * Use chacha6 to generate PRN since WG is taking care of security.
  */
-void chacha_hash(const u8 in[CHACHA_INPUT_SIZE],
-                 const u8 key[CHACHA20_KEY_SIZE], u8 *out, int out_words)
+static __always_inline void chacha_hash_with(const struct chacha_state *st,
+                                             const u8 *in, u8 *out,
+                                             int out_words, const bool ref,
+                                             const unsigned int rounds)
 {
-	struct chacha20_ctx ctx;
 	u32 x[CHACHA20_BLOCK_WORDS];
-	__le32 *stream = (__le32 *) out;
+	u32 nonce[CHACHA_NONCE_WORDS];
 	int i;
 
-	chacha20_init(&ctx, key, in);
-	for (i = 0; i < CHACHA20_BLOCK_WORDS; ++i)
-		x[i] = ctx.state[i];
+	for (i = 0; i < CHACHA_NONCE_WORD; ++i)
+		x[i] = st->state[i];
+
+	/* only the 4 nonce words change from packet to packet */
+	for (i = 0; i < CHACHA_NONCE_WORDS; ++i) {
+		nonce[i] = get_unaligned_le32(in + i * 4);
+		x[CHACHA_NONCE_WORD + i] = nonce[i];
+	}
+
+	if (ref)
+		CHACHA_ROUNDS(x, rounds);
+	else
+		CHACHA_PERMUTE(x, rounds);
+
+	for (i = 0; i < out_words && i < CHACHA_NONCE_WORD; ++i)
+		put_unaligned_le32(x[i] + st->state[i], out + i * 4);
+
+	for (; i < out_words; ++i)
+		put_unaligned_le32(x[i] + nonce[i - CHACHA_NONCE_WORD],
+		                   out + i * 4);
+}
+
+void chacha_hash(const struct chacha_state *st,
+                 const u8 in[CHACHA_INPUT_SIZE], u8 *out, int out_words)
+{
+	CHACHA_DISPATCH(st->rounds, chacha_hash_with, st, in, out, out_words,
+	                false);
+}
+
+/* the plain C rounds, reference of all other backends */
+static void chacha_blocks_ref(const struct chacha_state *st, const u8 *in,
+                              u8 *out, unsigned int nblocks)
+{
+	unsigned int i;
+
+	for (i = 0; i < nblocks; i++)
+		CHACHA_DISPATCH(st->rounds, chacha_hash_with, st,
+		                in + i * CHACHA_INPUT_SIZE,
+		                out + i * CHACHA20_BLOCK_SIZE,
+		                CHACHA20_BLOCK_WORDS, true);
+}
+
+static void chacha_blocks_generic(const struct chacha_state *st, const u8 *in,
+                                  u8 *out, unsigned int nblocks)
+{
+	unsigned int i;
+
+	for (i = 0; i < nblocks; i++)
+		chacha_hash(st, in + i * CHACHA_INPUT_SIZE,
+		            out + i * CHACHA20_BLOCK_SIZE, CHACHA20_BLOCK_WORDS);
+}
+
+static const struct chacha_backend chacha_generic = {
+	.name = CHACHA_SCALAR,
+	.lanes = 1,
+	.blocks = chacha_blocks_generic,
+};
+
+/* in order of preference when the benchmark is a tie */
+static const struct chacha_backend *const chacha_backends[] = {
+#ifdef CONFIG_X86_64
+#ifdef CHACHA_AVX512
+	&chacha_avx512,
+#endif
+	&chacha_avx2,
+	&chacha_sse2,
+#endif
+#ifdef CONFIG_KERNEL_MODE_NEON
+	&chacha_neon,
+#endif
+	&chacha_generic,
+	NULL
+};
+
+static const struct chacha_backend *chacha_backend __read_mostly =
+	&chacha_generic;
+static unsigned int chacha_min_blocks __read_mostly;
+
+static void chacha_blocks_with(const struct chacha_backend *b,
+                               const struct chacha_state *st, const u8 *in,
+                               u8 *out, unsigned int nblocks)
+{
+	unsigned int n;
+
+	if (nblocks < 2 || !b->begin || !b->begin()) {
+		chacha_blocks_generic(st, in, out, nblocks);
+		return;
+	}
+
+	while (nblocks) {
+		n = min(nblocks, b->lanes);
+		b->blocks(st, in, out, n);
+		in += n * CHACHA_INPUT_SIZE;
+		out += n * CHACHA20_BLOCK_SIZE;
+		nblocks -= n;
+	}
+
+	b->end();
+}
+
+void chacha_hash_blocks(const struct chacha_state *st, const u8 *in, u8 *out,
+                        unsigned int nblocks)
+{
+	chacha_blocks_with(chacha_backend, st, in, out, nblocks);
+}
+
+unsigned int chacha_batch_min(void)
+{
+	return chacha_min_blocks;
+}
+
+/* chacha6 of key 00 01 .. 1f and input a0 a1 .. af, from the scalar code */
+static const u8 chacha_kat_out[CHACHA20_BLOCK_SIZE] = {
+	0x2c, 0x6a, 0xa3, 0x85, 0x63, 0xa5, 0xbf, 0x1c,
+	0xa0, 0x5c, 0xfd, 0x6f, 0x2b, 0x56, 0x73, 0x04,
+	0xc1, 0xd6, 0xea, 0x5f, 0xa3, 0x61, 0x75, 0xfc,
+	0x96, 0x05, 0x23, 0x67, 0x33, 0x37, 0x07, 0xbb,
+	0x54, 0xa9, 0x04, 0xeb, 0xe8, 0x6c, 0xd1, 0xda,
+	0x2d, 0x32, 0x11, 0x17, 0xa3, 0x41, 0x94, 0x36,
+	0x52, 0xdb, 0x9e, 0xeb, 0x52, 0x83, 0xa3, 0x2b,
+	0xe3, 0x9e, 0xb8, 0x0b, 0x06, 0x82, 0xb5, 0xa5
+};
+
+/* Check the first lane against the known answer, and every lane and partial
+ * batch against the plain C code. Peers running other backends, or old
+ * builds, must see the same PRN.
+ */
+static bool chacha_selftest(const struct chacha_backend *b,
+                            struct chacha_state *st, u8 *in, u8 *out,
+                            u8 *ref)
+{
+	static const unsigned int rounds[] = { 6, 4, 8, 12 };
+	u8 key[CHACHA20_KEY_SIZE];
+	unsigned int i, n, r;
+	bool ok = true;
+
+	for (i = 0; i < CHACHA20_KEY_SIZE; i++)
+		key[i] = i;
+	for (i = 0; i < CHACHA_MAX_LANES * CHACHA_INPUT_SIZE; i++)
+		in[i] = 0xa0 + i;
+
+	for (r = 0; r < ARRAY_SIZE(rounds) && ok; r++) {
+		chacha_init_state(st, key, rounds[r]);
+		chacha_blocks_ref(st, in, ref, CHACHA_MAX_LANES);
+
+		/* the known answer is for 6 rounds */
+		if (rounds[r] == 6 &&
+		    memcmp(ref, chacha_kat_out, CHACHA20_BLOCK_SIZE))
+			return false;
+
+		for (n = 1; n <= b->lanes && ok; n++) {
+			memset(out, 0, n * CHACHA20_BLOCK_SIZE);
+			if (b->begin && !b->begin())
+				return false;
+			b->blocks(st, in, out, n);
+			if (b->end)
+				b->end();
+
+			ok = !memcmp(out, ref, n * CHACHA20_BLOCK_SIZE);
+		}
+	}
+
+	/* leave 6 rounds for the benchmark */
+	chacha_init_state(st, key, 6);
+	return ok;
+}
+
+enum {
+	CHACHA_BENCH_JIFFIES = 1,
+	CHACHA_BENCH_BLOCKS = 4,
+	CHACHA_BATCH_MAX = 3	/* head and counter blocks of v1 --obfs */
+};
+
+/* Count the blocks a backend hashes in a jiffy, in calls of @nblocks and with
+ * the SIMD save and restore included. The same way lib/raid6 picks its
+ * algorithm.
+ */
+static unsigned long chacha_bench(const struct chacha_backend *b,
+                                  const struct chacha_state *st, const u8 *in,
+                                  u8 *out, const unsigned int nblocks)
+{
+	unsigned long j0, j1, perf = 0;
+
+	preempt_disable();
+	j0 = jiffies;
+	while ((j1 = jiffies) == j0)
+		cpu_relax();
+	while (time_before(jiffies, j1 + CHACHA_BENCH_JIFFIES)) {
+		chacha_blocks_with(b, st, in, out, nblocks);
+		perf += nblocks;
+	}
+	preempt_enable();
+
+	return perf;
+}
+
+int chacha_select_backend(void)
+{
+	const struct chacha_backend *const *b;
+	const struct chacha_backend *best = &chacha_generic;
+	unsigned long perf, best_perf = 0;
+	struct chacha_state *st;
+	unsigned int n;
+	u8 *in, *out, *ref;
+	int ret = -ENOMEM;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	in = kmalloc(CHACHA_MAX_LANES * CHACHA_INPUT_SIZE, GFP_KERNEL);
+	out = kmalloc(2 * CHACHA_MAX_LANES * CHACHA20_BLOCK_SIZE, GFP_KERNEL);
+	if (!st || !in || !out)
+		goto out;
+
+	ref = out + CHACHA_MAX_LANES * CHACHA20_BLOCK_SIZE;
+	for (b = chacha_backends; *b; b++) {
+		if ((*b)->usable && !(*b)->usable())
+			continue;
+
+		if (!chacha_selftest(*b, st, in, out, ref)) {
+			pr_warn("WGOBFS: chacha %s failed self test\n", (*b)->name);
+			/* nothing to fall back to, peers would not understand us */
+			if (*b == &chacha_generic) {
+				ret = -EINVAL;
+				goto out;
+			}
+
+			continue;
+		}
+
+		perf = chacha_bench(*b, st, in, out, CHACHA_BENCH_BLOCKS);
+		pr_info("WGOBFS: chacha %-8s %lu blocks/jiffy\n", (*b)->name,
+		        perf / CHACHA_BENCH_JIFFIES);
+		if (perf > best_perf) {
+			best = *b;
+			best_perf = perf;
+		}
+	}
 
-	SIX_ROUNDS(x);
+	chacha_backend = best;
+	pr_info("WGOBFS: using chacha %s\n", best->name);
 
-	//for (i = 0; i < CHACHA_OUTPUT_WORDS; ++i)
-	for (i = 0; i < out_words; ++i)
-		stream[i] = cpu_to_le32(x[i] + ctx.state[i]);
+	/* The save and restore of the SIMD registers costs about as much as
+	 * hashing a block, a call of a few blocks may be slower than hashing
+	 * them one by one. The packet path asks for 3 at most.
+	 */
+	chacha_min_blocks = 0;
+	for (n = 2; best != &chacha_generic && n <= CHACHA_BATCH_MAX; n++) {
+		if (chacha_bench(best, st, in, out, n) >
+		    chacha_bench(&chacha_generic, st, in, out, n)) {
+			chacha_min_blocks = n;
+			break;
+		}
+	}
+	if (chacha_min_blocks)
+		pr_info("WGOBFS: chacha %s from %u blocks\n", best->name,
+		        chacha_min_blocks);
+	else
+		pr_info("WGOBFS: chacha %s not used for %u blocks or fewer\n",
+		        best->name, CHACHA_BATCH_MAX);
+	ret = 0;
+out:
+	kfree(out);
+	kfree(in);
+	kfree(st);
+	return ret;
 }
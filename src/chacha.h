@@ -3,8 +3,8 @@
  * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
  */
 
-#ifndef _XT_CHACHA8_H
-#define _XT_CHACHA8_H
+#ifndef _XT_CHACHA_H
+#define _XT_CHACHA_H
 
 #include <asm/unaligned.h>
 #include <linux/kernel.h>
@@ -19,9 +19,38 @@ enum chacha_lengths {
 	CHACHA_INPUT_SIZE = 16,
 	CHACHA_OUTPUT_SIZE = 32,
 	CHACHA_OUTPUT_WORDS = CHACHA_OUTPUT_SIZE / sizeof(u32),
+	CHACHA_MAX_LANES = 16,
 };
 
-void chacha_hash(const u8  in[CHACHA_INPUT_SIZE],
-                 const u8 key[CHACHA20_KEY_SIZE], u8 *out, int out_words);
+/* constants and key words of chacha, precomputed once per key */
+struct chacha_state {
+	u32 state[CHACHA20_BLOCK_WORDS];
+	unsigned int rounds;
+};
+
+/* @rounds is 4, 6, 8 or 12 */
+static inline bool chacha_rounds_valid(const unsigned int rounds)
+{
+	return rounds == 4 || rounds == 6 || rounds == 8 || rounds == 12;
+}
+
+void chacha_init_state(struct chacha_state *st,
+                       const u8 key[CHACHA20_KEY_SIZE], unsigned int rounds);
+
+void chacha_hash(const struct chacha_state *st,
+                 const u8 in[CHACHA_INPUT_SIZE], u8 *out, int out_words);
+
+/* Hash @nblocks inputs of 16 bytes into @nblocks full 64 bytes blocks, with the
+ * fastest backend picked by chacha_select_backend().
+ */
+void chacha_hash_blocks(const struct chacha_state *st, const u8 *in, u8 *out,
+                        unsigned int nblocks);
+
+/* The fewest blocks chacha_hash_blocks() hashes faster than chacha_hash() one
+ * by one, 0 if it never does. Measured by chacha_select_backend().
+ */
+unsigned int chacha_batch_min(void);
+
+int chacha_select_backend(void);
 
-#endif /* _XT_CHACHA8_H */
+#endif /* _XT_CHACHA_H */
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * arm and arm64 NEON chacha backend. Built without NEON flags.
+ */
+#include <linux/version.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#ifdef CONFIG_ARM64
+#include <asm/cpufeature.h>
+#endif
+#include "chacha_impl.h"
+
+static bool chacha_neon_begin(void)
+{
+	if (!may_use_simd())
+		return false;
+
+	kernel_neon_begin();
+	return true;
+}
+
+static void chacha_neon_end(void)
+{
+	kernel_neon_end();
+}
+
+static bool chacha_have_neon(void)
+{
+#ifdef CONFIG_ARM64
+	return system_supports_fpsimd();
+#else
+	return cpu_has_neon();
+#endif
+}
+
+const struct chacha_backend chacha_neon = {
+	.name = "neon",
+	.lanes = 4,
+	.usable = chacha_have_neon,
+	.begin = chacha_neon_begin,
+	.end = chacha_neon_end,
+	.blocks = chacha_blocks_neon,
+};
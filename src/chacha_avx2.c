@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * 8 blocks chacha, built with -mavx2
+ */
+#define CHACHA_LANES 8
+#define CHACHA_VEC_BLOCKS chacha_blocks_avx2
+#include "chacha_vec.h"
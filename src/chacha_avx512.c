@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * 16 blocks chacha, built with -mavx512f
+ */
+#define CHACHA_LANES 16
+#define CHACHA_VEC_BLOCKS chacha_blocks_avx512
+#include "chacha_vec.h"
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
+ *
+ * Internal to the chacha backends. The rounds are written once and shared by
+ * the scalar and the vector code, so all backends produce identical output.
+ */
+
+#ifndef _XT_CHACHA_IMPL_H
+#define _XT_CHACHA_IMPL_H
+
+#include "chacha.h"
+
+enum chacha_state_words {
+	CHACHA_CONSTANT_WORD = 0,
+	CHACHA_KEY_WORD = 4,
+	CHACHA_NONCE_WORD = 12,
+	CHACHA_NONCE_WORDS = CHACHA_INPUT_SIZE / sizeof(u32)
+};
+
+/* The vector backends redefine it for vector types */
+#ifndef CHACHA_ROTL
+#define CHACHA_ROTL(v, n) rol32(v, n)
+#endif
+
+#include "chacha_rounds.h"
+
+/* Call @fn with the round count as its last argument, a compile time
+ * constant. Every round count gets its own unrolled copy of the rounds, and
+ * no loop counts them at run time.
+ */
+#define CHACHA_DISPATCH(rounds, fn, ...) do { \
+	switch (rounds) { \
+	case 4: fn(__VA_ARGS__, 4); break; \
+	case 8: fn(__VA_ARGS__, 8); break; \
+	case 12: fn(__VA_ARGS__, 12); break; \
+	default: fn(__VA_ARGS__, 6); break; \
+	} \
+} while (0)
+
+struct chacha_backend {
+	const char *name;
+	unsigned int lanes;		/* blocks computed in parallel */
+	bool (*usable)(void);		/* CPU support, checked at load */
+	bool (*begin)(void);		/* false if SIMD is unusable now */
+	void (*end)(void);
+	void (*blocks)(const struct chacha_state *st, const u8 *in, u8 *out,
+	               unsigned int nblocks);	/* nblocks <= lanes */
+};
+
+#ifdef CONFIG_X86_64
+extern const struct chacha_backend chacha_sse2;
+extern const struct chacha_backend chacha_avx2;
+#ifdef CHACHA_AVX512
+extern const struct chacha_backend chacha_avx512;
+#endif
+
+void chacha_blocks_sse2(const struct chacha_state *st, const u8 *in, u8 *out,
+                        unsigned int nblocks);
+void chacha_blocks_avx2(const struct chacha_state *st, const u8 *in, u8 *out,
+                        unsigned int nblocks);
+void chacha_blocks_avx512(const struct chacha_state *st, const u8 *in,
+                          u8 *out, unsigned int nblocks);
+#endif /* CONFIG_X86_64 */
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+extern const struct chacha_backend chacha_neon;
+
+void chacha_blocks_neon(const struct chacha_state *st, const u8 *in, u8 *out,
+                        unsigned int nblocks);
+#endif
+
+#endif /* _XT_CHACHA_IMPL_H */
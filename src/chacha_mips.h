@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * chacha rounds for in-order MIPS32r2 cores, 24K, 34K, 74K and 1004K. The 16
+ * words are kept in registers, and the four quarter rounds of a column or a
+ * diagonal round are interleaved step by step. Every instruction has three
+ * independent ones between it and the result it needs. ror32() is a single
+ * rotr on MIPS32r2.
+ */
+
+#define MIPS_QR4(a0, b0, c0, d0, a1, b1, c1, d1, \
+                 a2, b2, c2, d2, a3, b3, c3, d3) do { \
+	a0 += b0; a1 += b1; a2 += b2; a3 += b3; \
+	d0 ^= a0; d1 ^= a1; d2 ^= a2; d3 ^= a3; \
+	d0 = ror32(d0, 16); d1 = ror32(d1, 16); \
+	d2 = ror32(d2, 16); d3 = ror32(d3, 16); \
+	c0 += d0; c1 += d1; c2 += d2; c3 += d3; \
+	b0 ^= c0; b1 ^= c1; b2 ^= c2; b3 ^= c3; \
+	b0 = ror32(b0, 20); b1 = ror32(b1, 20); \
+	b2 = ror32(b2, 20); b3 = ror32(b3, 20); \
+	a0 += b0; a1 += b1; a2 += b2; a3 += b3; \
+	d0 ^= a0; d1 ^= a1; d2 ^= a2; d3 ^= a3; \
+	d0 = ror32(d0, 24); d1 = ror32(d1, 24); \
+	d2 = ror32(d2, 24); d3 = ror32(d3, 24); \
+	c0 += d0; c1 += d1; c2 += d2; c3 += d3; \
+	b0 ^= c0; b1 ^= c1; b2 ^= c2; b3 ^= c3; \
+	b0 = ror32(b0, 25); b1 = ror32(b1, 25); \
+	b2 = ror32(b2, 25); b3 = ror32(b3, 25); \
+} while (0)
+
+#define MIPS_DOUBLE_ROUND() do { \
+	/* column round */ \
+	MIPS_QR4(x0, x4, x8, x12, x1, x5, x9, x13, \
+	         x2, x6, x10, x14, x3, x7, x11, x15); \
+	/* diagonal round */ \
+	MIPS_QR4(x0, x5, x10, x15, x1, x6, x11, x12, \
+	         x2, x7, x8, x13, x3, x4, x9, x14); \
+} while (0)
+
+/* @rounds is a compile time constant, see CHACHA_DISPATCH(), the conditions
+ * fold away and every count is straight line code.
+ */
+static __always_inline void chacha_permute_mips(u32 *x,
+                                                const unsigned int rounds)
+{
+	u32 x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+	u32 x4 = x[4], x5 = x[5], x6 = x[6], x7 = x[7];
+	u32 x8 = x[8], x9 = x[9], x10 = x[10], x11 = x[11];
+	u32 x12 = x[12], x13 = x[13], x14 = x[14], x15 = x[15];
+
+	MIPS_DOUBLE_ROUND();
+	MIPS_DOUBLE_ROUND();
+	if (rounds >= 6)
+		MIPS_DOUBLE_ROUND();
+	if (rounds >= 8)
+		MIPS_DOUBLE_ROUND();
+	if (rounds == 12) {
+		MIPS_DOUBLE_ROUND();
+		MIPS_DOUBLE_ROUND();
+	}
+
+	x[0] = x0; x[1] = x1; x[2] = x2; x[3] = x3;
+	x[4] = x4; x[5] = x5; x[6] = x6; x[7] = x7;
+	x[8] = x8; x[9] = x9; x[10] = x10; x[11] = x11;
+	x[12] = x12; x[13] = x13; x[14] = x14; x[15] = x15;
+}
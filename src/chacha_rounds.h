@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Copyright (C) 2015-2019 Jason A. Donenfeld <Jason@zx2c4.com>. All Rights Reserved.
+ *
+ * The chacha constants and rounds, without kernel headers. Shared by the
+ * backends of the module and the XDP program, which define CHACHA_ROTL first.
+ */
+
+#ifndef _XT_CHACHA_ROUNDS_H
+#define _XT_CHACHA_ROUNDS_H
+
+enum chacha20_constants { /* expand 32-byte k */
+	CHACHA20_CONSTANT_EXPA = 0x61707865U,
+	CHACHA20_CONSTANT_ND_3 = 0x3320646eU,
+	CHACHA20_CONSTANT_2_BY = 0x79622d32U,
+	CHACHA20_CONSTANT_TE_K = 0x6b206574U
+};
+
+#define QUARTER_ROUND(x, a, b, c, d) ( \
+	x[a] += x[b], \
+	x[d] = CHACHA_ROTL((x[d] ^ x[a]), 16), \
+	x[c] += x[d], \
+	x[b] = CHACHA_ROTL((x[b] ^ x[c]), 12), \
+	x[a] += x[b], \
+	x[d] = CHACHA_ROTL((x[d] ^ x[a]), 8), \
+	x[c] += x[d], \
+	x[b] = CHACHA_ROTL((x[b] ^ x[c]), 7) \
+)
+
+#define C(i, j) (i * 4 + j)
+
+#define DOUBLE_ROUND(x) ( \
+	/* Column Round */ \
+	QUARTER_ROUND(x, C(0, 0), C(1, 0), C(2, 0), C(3, 0)), \
+	QUARTER_ROUND(x, C(0, 1), C(1, 1), C(2, 1), C(3, 1)), \
+	QUARTER_ROUND(x, C(0, 2), C(1, 2), C(2, 2), C(3, 2)), \
+	QUARTER_ROUND(x, C(0, 3), C(1, 3), C(2, 3), C(3, 3)), \
+	/* Diagonal Round */ \
+	QUARTER_ROUND(x, C(0, 0), C(1, 1), C(2, 2), C(3, 3)), \
+	QUARTER_ROUND(x, C(0, 1), C(1, 2), C(2, 3), C(3, 0)), \
+	QUARTER_ROUND(x, C(0, 2), C(1, 3), C(2, 0), C(3, 1)), \
+	QUARTER_ROUND(x, C(0, 3), C(1, 0), C(2, 1), C(3, 2)) \
+)
+
+#define FOUR_ROUNDS(x) ( \
+	DOUBLE_ROUND(x), \
+	DOUBLE_ROUND(x) \
+)
+
+#define SIX_ROUNDS(x) ( \
+	DOUBLE_ROUND(x), \
+	DOUBLE_ROUND(x), \
+	DOUBLE_ROUND(x) \
+)
+
+#define EIGHT_ROUNDS(x) ( \
+	FOUR_ROUNDS(x), \
+	FOUR_ROUNDS(x) \
+)
+
+#define TWELVE_ROUNDS(x) ( \
+	SIX_ROUNDS(x), \
+	SIX_ROUNDS(x) \
+)
+
+/* @rounds must be a compile time constant */
+#define CHACHA_ROUNDS(x, rounds) ( \
+	(rounds) == 4 ? (FOUR_ROUNDS(x), 0) : \
+	(rounds) == 8 ? (EIGHT_ROUNDS(x), 0) : \
+	(rounds) == 12 ? (TWELVE_ROUNDS(x), 0) : \
+	(SIX_ROUNDS(x), 0) \
+)
+
+#endif /* _XT_CHACHA_ROUNDS_H */
@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * 4 blocks chacha, built with -msse2
+ */
+#define CHACHA_LANES 4
+#define CHACHA_VEC_BLOCKS chacha_blocks_sse2
+#include "chacha_vec.h"
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Multi-block chacha with GCC vector extensions. Each lane of a vector holds
+ * the same word of a different block, so CHACHA_LANES independent inputs are
+ * hashed at the cost of one. Included by the per instruction set files, which
+ * are built with the matching -m flags and define:
+ *
+ *   CHACHA_LANES       blocks per call
+ *   CHACHA_VEC_BLOCKS  name of the function
+ *
+ * Must only be called between the begin() and end() of its backend.
+ */
+
+#include <linux/types.h>
+
+typedef u32 chacha_vec __attribute__((vector_size(CHACHA_LANES * sizeof(u32))));
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#include "chacha_impl.h"
+
+static __always_inline void chacha_vec_blocks(const struct chacha_state *st,
+                                              const u8 *in, u8 *out,
+                                              unsigned int nblocks,
+                                              const unsigned int rounds)
+{
+	chacha_vec x[CHACHA20_BLOCK_WORDS];
+	chacha_vec nonce[CHACHA_NONCE_WORDS];
+	unsigned int i, l;
+
+	for (i = 0; i < CHACHA_NONCE_WORD; i++)
+		x[i] = (chacha_vec) {} + st->state[i];
+
+	/* unused lanes are hashed but not stored */
+	for (i = 0; i < CHACHA_NONCE_WORDS; i++) {
+		nonce[i] = (chacha_vec) {};
+		for (l = 0; l < nblocks; l++)
+			nonce[i][l] = get_unaligned_le32(in + l * CHACHA_INPUT_SIZE +
+			                                 i * 4);
+		x[CHACHA_NONCE_WORD + i] = nonce[i];
+	}
+
+	CHACHA_ROUNDS(x, rounds);
+
+	for (i = 0; i < CHACHA_NONCE_WORD; i++)
+		x[i] += st->state[i];
+	for (i = 0; i < CHACHA_NONCE_WORDS; i++)
+		x[CHACHA_NONCE_WORD + i] += nonce[i];
+
+	for (l = 0; l < nblocks; l++)
+		for (i = 0; i < CHACHA20_BLOCK_WORDS; i++)
+			put_unaligned_le32(x[i][l], out + l * CHACHA20_BLOCK_SIZE +
+			                   i * 4);
+}
+
+void CHACHA_VEC_BLOCKS(const struct chacha_state *st, const u8 *in, u8 *out,
+                       unsigned int nblocks)
+{
+	CHACHA_DISPATCH(st->rounds, chacha_vec_blocks, st, in, out, nblocks);
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * x86 chacha backends. Built without SIMD flags, since the CPU checks run
+ * before any backend is known to be usable.
+ */
+#include <linux/version.h>
+#include <asm/cpufeature.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
+#include <asm/fpu/api.h>
+#else
+#include <asm/i387.h>
+#endif
+#include "chacha_impl.h"
+
+/* softirq may interrupt a task that is using the FPU */
+static bool chacha_x86_begin(void)
+{
+	if (!irq_fpu_usable())
+		return false;
+
+	kernel_fpu_begin();
+	return true;
+}
+
+static void chacha_x86_end(void)
+{
+	kernel_fpu_end();
+}
+
+static bool chacha_have_sse2(void)
+{
+	return boot_cpu_has(X86_FEATURE_XMM2);
+}
+
+static bool chacha_have_avx2(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+	return boot_cpu_has(X86_FEATURE_AVX) &&
+	       boot_cpu_has(X86_FEATURE_AVX2) &&
+	       cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL);
+#else
+	return false;
+#endif
+}
+
+#ifdef CHACHA_AVX512
+static bool chacha_have_avx512(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+	return boot_cpu_has(X86_FEATURE_AVX512F) &&
+	       cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+	                         XFEATURE_MASK_AVX512, NULL);
+#else
+	return false;
+#endif
+}
+#endif
+
+const struct chacha_backend chacha_sse2 = {
+	.name = "sse2",
+	.lanes = 4,
+	.usable = chacha_have_sse2,
+	.begin = chacha_x86_begin,
+	.end = chacha_x86_end,
+	.blocks = chacha_blocks_sse2,
+};
+
+const struct chacha_backend chacha_avx2 = {
+	.name = "avx2",
+	.lanes = 8,
+	.usable = chacha_have_avx2,
+	.begin = chacha_x86_begin,
+	.end = chacha_x86_end,
+	.blocks = chacha_blocks_avx2,
+};
+
+#ifdef CHACHA_AVX512
+const struct chacha_backend chacha_avx512 = {
+	.name = "avx512",
+	.lanes = 16,
+	.usable = chacha_have_avx512,
+	.begin = chacha_x86_begin,
+	.end = chacha_x86_end,
+	.blocks = chacha_blocks_avx512,
+};
+#endif
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Token bucket per source address for the handshakes of a --unobfs rule.
+ *
+ * Every CPU has its own table and x_tables runs targets with BH disabled, so
+ * a lookup takes no lock. With RSS the packets of a source stay on one CPU.
+ * The table is direct mapped. A source that is not in it pays from one bucket
+ * shared by all new sources. If that lets it through, it takes the slot, with
+ * no credit left, but only once the source in the slot has been idle long
+ * enough to refill its bucket, as WireGuard expires the entries of its own
+ * ratelimiter. Rotating or spoofed addresses then get @rate handshakes per
+ * second between them, not a burst each, and cannot evict an active source.
+ *
+ * A handshake costs HZ credits and a bucket gains @rate credits per jiffy, so
+ * the limit is @rate handshakes per second with a burst of @burst.
+ */
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include "hs_limit.h"
+
+enum {
+	HS_TABLE_BITS = 8,
+	HS_TABLE_SIZE = 1 << HS_TABLE_BITS
+};
+
+struct hs_bucket {
+	__be32 saddr;
+	u32 credit;
+	unsigned long stamp;
+};
+
+struct hs_table {
+	struct hs_bucket newcomers;
+	struct hs_bucket b[HS_TABLE_SIZE];
+};
+
+struct wg_hs_limit {
+	struct hs_table __percpu *tbl;
+	u32 rate;
+	u32 max_credit;
+	u32 seed;
+};
+
+struct wg_hs_limit *wg_hs_limit_create(const u32 rate, const u32 burst)
+{
+	struct wg_hs_limit *hs;
+
+	hs = kmalloc(sizeof(*hs), GFP_KERNEL);
+	if (!hs)
+		return NULL;
+
+	/* zeroed, an empty slot matches no source but 0.0.0.0, and a bucket
+	 * stamped 0 is full
+	 */
+	hs->tbl = alloc_percpu(struct hs_table);
+	if (!hs->tbl) {
+		kfree(hs);
+		return NULL;
+	}
+
+	hs->rate = rate;
+	hs->max_credit = burst * HZ;
+	get_random_bytes(&hs->seed, sizeof(hs->seed));
+	return hs;
+}
+
+void wg_hs_limit_destroy(struct wg_hs_limit *hs)
+{
+	if (!hs)
+		return;
+
+	free_percpu(hs->tbl);
+	kfree(hs);
+}
+
+/* the credit of the bucket refilled for the jiffies since its last handshake */
+static u64 hs_bucket_credit(const struct wg_hs_limit *hs,
+                            const struct hs_bucket *b, const unsigned long now)
+{
+	u64 credit;
+
+	/* a rate is at least 1 */
+	if (now - b->stamp >= hs->max_credit)
+		return hs->max_credit;
+
+	credit = (u64) (now - b->stamp) * hs->rate + b->credit;
+	return min_t(u64, credit, hs->max_credit);
+}
+
+/* refill the bucket, then take one handshake from it */
+static bool hs_bucket_take(const struct wg_hs_limit *hs, struct hs_bucket *b,
+                           const unsigned long now)
+{
+	u64 credit = hs_bucket_credit(hs, b, now);
+
+	b->stamp = now;
+	if (credit < HZ) {
+		b->credit = credit;
+		return false;
+	}
+
+	b->credit = credit - HZ;
+	return true;
+}
+
+bool wg_hs_limit_allow(struct wg_hs_limit *hs, const __be32 saddr)
+{
+	struct hs_table *t = this_cpu_ptr(hs->tbl);
+	struct hs_bucket *b;
+	unsigned long now;
+
+	b = &t->b[jhash_1word((__force u32) saddr,
+	                      hs->seed) >> (32 - HS_TABLE_BITS)];
+	now = jiffies;
+	if (b->saddr == saddr)
+		return hs_bucket_take(hs, b, now);
+
+	if (!hs_bucket_take(hs, &t->newcomers, now))
+		return false;
+
+	/* an active source keeps its slot, the newcomer stays in the shared
+	 * bucket
+	 */
+	if (hs_bucket_credit(hs, b, now) < hs->max_credit)
+		return true;
+
+	/* this handshake used up its first credit */
+	b->saddr = saddr;
+	b->credit = 0;
+	b->stamp = now;
+	return true;
+}
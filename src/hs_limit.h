@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_HS_LIMIT_H
+#define _XT_WGOBFS_HS_LIMIT_H
+
+#include <linux/types.h>
+
+struct wg_hs_limit;
+
+struct wg_hs_limit *wg_hs_limit_create(const u32 rate, const u32 burst);
+void wg_hs_limit_destroy(struct wg_hs_limit *hs);
+bool wg_hs_limit_allow(struct wg_hs_limit *hs, const __be32 saddr);
+
+#endif /* _XT_WGOBFS_HS_LIMIT_H */
@@ -0,0 +1,190 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Latency of the target, sampled 1 in N packets on every CPU, in log2 ns
+ * histograms by direction, WG message type and packet size. In debugfs:
+ *
+ *   xt_wgobfs/sample   N, 0 turns sampling off, the default
+ *   xt_wgobfs/reset    write 1 to clear the histograms
+ *   xt_wgobfs/latency  the histograms that have samples
+ *
+ * While sampling is off, the packet path only has a patched out jump.
+ */
+#include <linux/version.h>
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <linux/sched/clock.h>
+#else
+#include <linux/sched.h>
+#endif
+#include <linux/seq_file.h>
+#include "latency.h"
+#include "xt_WGOBFS.h"
+
+enum {
+	LAT_TYPES = 5,		/* WG types 1 to 4, then unknown or dropped */
+	LAT_SIZES = 4,
+	LAT_BUCKETS = 32
+};
+
+static const char *const lat_type_names[LAT_TYPES] = {
+	"handshake_init", "handshake_resp", "cookie", "data", "other"
+};
+
+static const char *const lat_size_names[LAT_SIZES] = {
+	"<128", "<512", "<1024", ">=1024"
+};
+
+struct lat_hist {
+	unsigned int tick;
+	u32 n[2][LAT_TYPES][LAT_SIZES][LAT_BUCKETS];
+};
+
+static struct lat_hist __percpu *lat_hists;
+static u32 lat_sample;
+static struct dentry *lat_dir;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+DEFINE_STATIC_KEY_FALSE(wg_obfs_lat_on);
+#define lat_turn_on() static_branch_enable(&wg_obfs_lat_on)
+#define lat_turn_off() static_branch_disable(&wg_obfs_lat_on)
+#else
+bool wg_obfs_lat_on __read_mostly;
+#define lat_turn_on() (wg_obfs_lat_on = true)
+#define lat_turn_off() (wg_obfs_lat_on = false)
+#endif
+
+/* targets run with BH disabled */
+u64 wg_obfs_lat_start(void)
+{
+	struct lat_hist *h = this_cpu_ptr(lat_hists);
+	u32 n = READ_ONCE(lat_sample);
+
+	if (!n || ++h->tick < n)
+		return 0;
+
+	h->tick = 0;
+	return local_clock() ? : 1;
+}
+
+void wg_obfs_lat_end(const u64 start, const u8 mode, const u8 type,
+                     const unsigned int len)
+{
+	struct lat_hist *h = this_cpu_ptr(lat_hists);
+	u64 ns = local_clock() - start;
+	int t, s, b;
+
+	t = type >= 1 && type <= 4 ? type - 1 : LAT_TYPES - 1;
+	s = len < 128 ? 0 : len < 512 ? 1 : len < 1024 ? 2 : 3;
+	b = ns ? ilog2(ns) : 0;
+	if (b >= LAT_BUCKETS)
+		b = LAT_BUCKETS - 1;
+
+	h->n[mode == XT_MODE_OBFS ? 0 : 1][t][s][b]++;
+}
+
+static int lat_show(struct seq_file *seq, void *v)
+{
+	u32 sum[LAT_BUCKETS];
+	u32 total;
+	int cpu, d, t, s, b;
+
+	seq_puts(seq, "# mode type size, then samples of 2^i to 2^(i+1) ns\n");
+	for (d = 0; d < 2; d++)
+	for (t = 0; t < LAT_TYPES; t++)
+	for (s = 0; s < LAT_SIZES; s++) {
+		memset(sum, 0, sizeof(sum));
+		total = 0;
+		for_each_possible_cpu(cpu) {
+			const u32 *n = per_cpu_ptr(lat_hists, cpu)->n[d][t][s];
+
+			for (b = 0; b < LAT_BUCKETS; b++) {
+				sum[b] += n[b];
+				total |= n[b];
+			}
+		}
+
+		if (!total)
+			continue;
+
+		seq_printf(seq, "%s %s %s", d ? "unobfs" : "obfs",
+		           lat_type_names[t], lat_size_names[s]);
+		for (b = 0; b < LAT_BUCKETS; b++)
+			seq_printf(seq, " %u", sum[b]);
+		seq_putc(seq, '\n');
+	}
+
+	return 0;
+}
+
+static int lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lat_show, NULL);
+}
+
+static const struct file_operations lat_fops = {
+	.owner = THIS_MODULE,
+	.open = lat_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int lat_sample_get(void *data, u64 *val)
+{
+	*val = lat_sample;
+	return 0;
+}
+
+static int lat_sample_set(void *data, u64 val)
+{
+	if (val > U32_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(lat_sample, val);
+	if (val)
+		lat_turn_on();
+	else
+		lat_turn_off();
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(lat_sample_fops, lat_sample_get, lat_sample_set,
+                        "%llu\n");
+
+/* samples taken meanwhile on other CPUs may be lost or kept */
+static int lat_reset_set(void *data, u64 val)
+{
+	int cpu;
+
+	if (val != 1)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(lat_hists, cpu)->n, 0,
+		       sizeof(lat_hists->n));
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(lat_reset_fops, NULL, lat_reset_set, "%llu\n");
+
+/* without memory or debugfs, sampling just cannot be turned on */
+void wg_obfs_lat_init(void)
+{
+	lat_hists = alloc_percpu(struct lat_hist);
+	if (!lat_hists)
+		return;
+
+	lat_dir = debugfs_create_dir("xt_wgobfs", NULL);
+	debugfs_create_file("sample", 0600, lat_dir, NULL, &lat_sample_fops);
+	debugfs_create_file("reset", 0200, lat_dir, NULL, &lat_reset_fops);
+	debugfs_create_file("latency", 0400, lat_dir, NULL, &lat_fops);
+}
+
+void wg_obfs_lat_exit(void)
+{
+	debugfs_remove_recursive(lat_dir);
+	lat_turn_off();
+	free_percpu(lat_hists);
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_LATENCY_H
+#define _XT_WGOBFS_LATENCY_H
+
+#include <linux/version.h>
+#include <linux/types.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+#include <linux/jump_label.h>
+
+/* sampling is on, a jump patched into the packet path */
+DECLARE_STATIC_KEY_FALSE(wg_obfs_lat_on);
+#define wg_obfs_lat_enabled() static_branch_unlikely(&wg_obfs_lat_on)
+#else
+extern bool wg_obfs_lat_on;
+#define wg_obfs_lat_enabled() unlikely(wg_obfs_lat_on)
+#endif
+
+/* the start time if this packet is sampled, or 0 */
+u64 wg_obfs_lat_start(void);
+/* @type is the WG message type, 0 if unknown */
+void wg_obfs_lat_end(const u64 start, const u8 mode, const u8 type,
+                     const unsigned int len);
+void wg_obfs_lat_init(void);
+void wg_obfs_lat_exit(void);
+
+#endif /* _XT_WGOBFS_LATENCY_H */
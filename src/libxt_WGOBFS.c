@@ -2,6 +2,7 @@
  * iptables WGOBFS target extension
  */
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
@@ -12,12 +13,26 @@ enum {
         FLAGS_KEY    = 1 << 0,
         FLAGS_OBFS   = 1 << 1,
         FLAGS_UNOBFS = 1 << 2,
+        FLAGS_WIRE_VER = 1 << 3,
+        FLAGS_ROUNDS = 1 << 4,
+        FLAGS_PRF = 1 << 5,
+        FLAGS_UDP_CSUM = 1 << 6,
+        FLAGS_PADDING = 1 << 7,
+        FLAGS_HS_LIMIT = 1 << 8,
+        FLAGS_HS_BURST = 1 << 9,
 };
 
 enum {
         OPT_KEY = 0,
         OPT_OBFS,
-        OPT_UNOBFS
+        OPT_UNOBFS,
+        OPT_WIRE_VER,
+        OPT_ROUNDS,
+        OPT_PRF,
+        OPT_UDP_CSUM,
+        OPT_PADDING,
+        OPT_HS_LIMIT,
+        OPT_HS_BURST
 };
 
 enum {
@@ -32,6 +47,20 @@ static const struct option wg_obfs_opts[] = {
         { },
 };
 
+static const struct option wg_obfs_opts_v1[] = {
+        {.name = "key",.has_arg = true,.val = OPT_KEY },
+        {.name = "obfs",.has_arg = false,.val = OPT_OBFS },
+        {.name = "unobfs",.has_arg = false,.val = OPT_UNOBFS },
+        {.name = "wire-ver",.has_arg = true,.val = OPT_WIRE_VER },
+        {.name = "rounds",.has_arg = true,.val = OPT_ROUNDS },
+        {.name = "prf",.has_arg = true,.val = OPT_PRF },
+        {.name = "udp-csum",.has_arg = true,.val = OPT_UDP_CSUM },
+        {.name = "padding",.has_arg = true,.val = OPT_PADDING },
+        {.name = "hs-limit",.has_arg = true,.val = OPT_HS_LIMIT },
+        {.name = "hs-burst",.has_arg = true,.val = OPT_HS_BURST },
+        { },
+};
+
 static void wg_obfs_help(void)
 {
         printf("WGOBFS target options:\n"
@@ -39,6 +68,33 @@ static void wg_obfs_help(void)
                "    --obfs or --unobfs\n");
 }
 
+static void wg_obfs_help_v1(void)
+{
+        wg_obfs_help();
+        printf("    --wire-ver <1|2>  wire format of --obfs, default 1\n"
+               "    --rounds <4|6|8|12>  chacha rounds, default 6, must match"
+               " the peer\n"
+               "    --prf <chacha|siphash|halfsiphash|aes>  PRN generator,"
+               " default chacha, must match the peer\n"
+               "    --udp-csum <keep|none|sw>  none sends --obfs packets"
+               " without UDP checksum,\n"
+               "                               sw does not leave it to the"
+               " NIC\n"
+               "    --padding <copy|frag>  frag appends the padding of --obfs"
+               " as a page fragment\n"
+               "    --hs-limit <n>  handshakes per second per source that"
+               " --unobfs lets through\n"
+               "    --hs-burst <n>  handshakes a source may send at once,"
+               " default 5\n");
+}
+
+static const char *const wg_obfs_prf_names[] = {
+        [XT_WGOBFS_PRF_CHACHA] = "chacha",
+        [XT_WGOBFS_PRF_SIPHASH] = "siphash",
+        [XT_WGOBFS_PRF_HSIPHASH] = "halfsiphash",
+        [XT_WGOBFS_PRF_AES] = "aes",
+};
+
 /* repeat a input string until it reaches @outlen */
 static void expand_string(const char *s, int len, char *outbuf, int outlen)
 {
@@ -55,13 +111,13 @@ static void expand_string(const char *s, int len, char *outbuf, int outlen)
         }
 }
 
-static int wg_obfs_parse(int c, char **argv, int z1, unsigned int *flags,
-                         const void *z2, struct xt_entry_target **tgt)
+/* parse the options shared by all revisions */
+static int wg_obfs_parse_common(int c, unsigned int *flags,
+                                unsigned char *mode, char *key,
+                                unsigned char *chacha_key)
 {
-        struct xt_wg_obfs_info *info = (void *) (*tgt)->data;
         unsigned long len;
         const char *s = optarg;
-        char chacha_key[XT_CHACHA_KEY_SIZE];
 
         switch (c) {
         case OPT_KEY:
@@ -71,17 +127,16 @@ static int wg_obfs_parse(int c, char **argv, int z1, unsigned int *flags,
                                       "WGOBFS: Max key size is %d",
                                       XT_WGOBFS_MAX_KEY_SIZE);
 
-                strncpy(info->key, s, XT_WGOBFS_MAX_KEY_SIZE);
+                strncpy(key, s, XT_WGOBFS_MAX_KEY_SIZE);
                 *flags |= FLAGS_KEY;
-                expand_string(s, len, chacha_key, XT_CHACHA_KEY_SIZE);
-                memcpy(info->chacha_key, chacha_key, XT_CHACHA_KEY_SIZE);
+                expand_string(s, len, (char *) chacha_key, XT_CHACHA_KEY_SIZE);
                 return true;
         case OPT_OBFS:
-                info->mode = XT_MODE_OBFS;
+                *mode = XT_MODE_OBFS;
                 *flags |= FLAGS_OBFS;
                 return true;
         case OPT_UNOBFS:
-                info->mode = XT_MODE_UNOBFS;
+                *mode = XT_MODE_UNOBFS;
                 *flags |= FLAGS_UNOBFS;
                 return true;
         }
@@ -89,6 +144,110 @@ static int wg_obfs_parse(int c, char **argv, int z1, unsigned int *flags,
         return false;
 }
 
+static int wg_obfs_parse(int c, char **argv, int z1, unsigned int *flags,
+                         const void *z2, struct xt_entry_target **tgt)
+{
+        struct xt_wg_obfs_info *info = (void *) (*tgt)->data;
+
+        return wg_obfs_parse_common(c, flags, &info->mode, info->key,
+                                    info->chacha_key);
+}
+
+static void wg_obfs_init_v1(struct xt_entry_target *tgt)
+{
+        struct xt_wg_obfs_info_v1 *info = (void *) tgt->data;
+
+        info->wire_ver = XT_WGOBFS_WIRE_V1;
+        info->rounds = XT_WGOBFS_DEFAULT_ROUNDS;
+        info->hs_burst = XT_WGOBFS_HS_BURST;
+}
+
+static int wg_obfs_parse_v1(int c, char **argv, int z1, unsigned int *flags,
+                            const void *z2, struct xt_entry_target **tgt)
+{
+        struct xt_wg_obfs_info_v1 *info = (void *) (*tgt)->data;
+        unsigned int ver, rounds, prf, n;
+
+        switch (c) {
+        case OPT_WIRE_VER:
+                if (!xtables_strtoui(optarg, NULL, &ver, XT_WGOBFS_WIRE_V1,
+                                     XT_WGOBFS_WIRE_V2))
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --wire-ver must be 1 or 2");
+
+                info->wire_ver = ver;
+                *flags |= FLAGS_WIRE_VER;
+                return true;
+        case OPT_ROUNDS:
+                if (!xtables_strtoui(optarg, NULL, &rounds, 4, 12) ||
+                    (rounds != 4 && rounds != 6 && rounds != 8 && rounds != 12))
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --rounds must be 4, 6, 8 or 12");
+
+                info->rounds = rounds;
+                *flags |= FLAGS_ROUNDS;
+                return true;
+        case OPT_PRF:
+                for (prf = 0; prf <= XT_WGOBFS_PRF_AES; prf++)
+                        if (!strcmp(optarg, wg_obfs_prf_names[prf]))
+                                break;
+
+                if (prf > XT_WGOBFS_PRF_AES)
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: unknown --prf %s", optarg);
+
+                info->prf = prf;
+                *flags |= FLAGS_PRF;
+                return true;
+        case OPT_UDP_CSUM:
+                if (!strcmp(optarg, "keep"))
+                        info->udp_csum = XT_WGOBFS_UDP_CSUM_KEEP;
+                else if (!strcmp(optarg, "none"))
+                        info->udp_csum = XT_WGOBFS_UDP_CSUM_NONE;
+                else if (!strcmp(optarg, "sw"))
+                        info->udp_csum = XT_WGOBFS_UDP_CSUM_SW;
+                else
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --udp-csum must be keep, none"
+                                      " or sw");
+
+                *flags |= FLAGS_UDP_CSUM;
+                return true;
+        case OPT_PADDING:
+                if (!strcmp(optarg, "copy"))
+                        info->padding = XT_WGOBFS_PADDING_COPY;
+                else if (!strcmp(optarg, "frag"))
+                        info->padding = XT_WGOBFS_PADDING_FRAG;
+                else
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --padding must be copy or frag");
+
+                *flags |= FLAGS_PADDING;
+                return true;
+        case OPT_HS_LIMIT:
+                if (!xtables_strtoui(optarg, NULL, &n, 1, XT_WGOBFS_HS_MAX))
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --hs-limit must be 1 to %u",
+                                      XT_WGOBFS_HS_MAX);
+
+                info->hs_rate = n;
+                *flags |= FLAGS_HS_LIMIT;
+                return true;
+        case OPT_HS_BURST:
+                if (!xtables_strtoui(optarg, NULL, &n, 1, XT_WGOBFS_HS_MAX))
+                        xtables_error(PARAMETER_PROBLEM,
+                                      "WGOBFS: --hs-burst must be 1 to %u",
+                                      XT_WGOBFS_HS_MAX);
+
+                info->hs_burst = n;
+                *flags |= FLAGS_HS_BURST;
+                return true;
+        }
+
+        return wg_obfs_parse_common(c, flags, &info->mode, info->key,
+                                    info->chacha_key);
+}
+
 static void wg_obfs_check(unsigned int flags)
 {
         if (!(flags & FLAGS_KEY))
@@ -100,6 +259,20 @@ static void wg_obfs_check(unsigned int flags)
                               "WGOBFS: --obfs or --unobfs is required.");
 }
 
+static void wg_obfs_check_v1(unsigned int flags)
+{
+        wg_obfs_check(flags);
+
+        if ((flags & (FLAGS_HS_LIMIT | FLAGS_HS_BURST)) &&
+            !(flags & FLAGS_UNOBFS))
+                xtables_error(PARAMETER_PROBLEM,
+                              "WGOBFS: --hs-limit only works with --unobfs.");
+
+        if ((flags & FLAGS_HS_BURST) && !(flags & FLAGS_HS_LIMIT))
+                xtables_error(PARAMETER_PROBLEM,
+                              "WGOBFS: --hs-burst needs --hs-limit.");
+}
+
 /* invoke by `iptables -L` to show previously inserted rules */
 static void wg_obfs_print(const void *z1, const struct xt_entry_target *tgt,
                           int z2)
@@ -122,22 +295,76 @@ static void wg_obfs_save(const void *u, const struct xt_entry_target *tgt)
                 printf(" --key %s --unobfs", info->key);
 }
 
-static struct xtables_target wg_obfs_reg = {
-         .version = XTABLES_VERSION,
-         .name = "WGOBFS",
-         .revision = 0,
-         .family = NFPROTO_IPV4,
-         .size =          XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
-         .userspacesize = XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
-         .help = wg_obfs_help,
-         .parse = wg_obfs_parse,
-         .final_check = wg_obfs_check,
-         .print = wg_obfs_print,
-         .save = wg_obfs_save,
-         .extra_opts = wg_obfs_opts,
+static void wg_obfs_save_v1(const void *u, const struct xt_entry_target *tgt)
+{
+        const struct xt_wg_obfs_info_v1 *info = (const void *) tgt->data;
+        if (info->mode == XT_MODE_OBFS)
+                printf(" --key %s --obfs", info->key);
+        else if (info->mode == XT_MODE_UNOBFS)
+                printf(" --key %s --unobfs", info->key);
+
+        /* the default is not printed, old iptables can restore the rule */
+        if (info->wire_ver != XT_WGOBFS_WIRE_V1)
+                printf(" --wire-ver %u", info->wire_ver);
+        if (info->rounds != XT_WGOBFS_DEFAULT_ROUNDS)
+                printf(" --rounds %u", info->rounds);
+        if (info->prf != XT_WGOBFS_PRF_CHACHA &&
+            info->prf <= XT_WGOBFS_PRF_AES)
+                printf(" --prf %s", wg_obfs_prf_names[info->prf]);
+        if (info->udp_csum == XT_WGOBFS_UDP_CSUM_NONE)
+                printf(" --udp-csum none");
+        else if (info->udp_csum == XT_WGOBFS_UDP_CSUM_SW)
+                printf(" --udp-csum sw");
+        if (info->padding == XT_WGOBFS_PADDING_FRAG)
+                printf(" --padding frag");
+        if (info->hs_rate) {
+                printf(" --hs-limit %u", info->hs_rate);
+                if (info->hs_burst != XT_WGOBFS_HS_BURST)
+                        printf(" --hs-burst %u", info->hs_burst);
+        }
+}
+
+static void wg_obfs_print_v1(const void *z1, const struct xt_entry_target *tgt,
+                             int z2)
+{
+        wg_obfs_save_v1(z1, tgt);
+}
+
+static struct xtables_target wg_obfs_reg[] = {
+        {
+                .version = XTABLES_VERSION,
+                .name = "WGOBFS",
+                .revision = 0,
+                .family = NFPROTO_IPV4,
+                .size =          XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
+                .userspacesize = XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
+                .help = wg_obfs_help,
+                .parse = wg_obfs_parse,
+                .final_check = wg_obfs_check,
+                .print = wg_obfs_print,
+                .save = wg_obfs_save,
+                .extra_opts = wg_obfs_opts,
+        },
+        {
+                .version = XTABLES_VERSION,
+                .name = "WGOBFS",
+                .revision = 1,
+                .family = NFPROTO_IPV4,
+                .size =          XT_ALIGN(sizeof(struct xt_wg_obfs_info_v1)),
+                /* the kernel sets id, it is not compared */
+                .userspacesize = offsetof(struct xt_wg_obfs_info_v1, id),
+                .help = wg_obfs_help_v1,
+                .init = wg_obfs_init_v1,
+                .parse = wg_obfs_parse_v1,
+                .final_check = wg_obfs_check_v1,
+                .print = wg_obfs_print_v1,
+                .save = wg_obfs_save_v1,
+                .extra_opts = wg_obfs_opts_v1,
+        },
 };
 
 static __attribute__((constructor)) void wg_obfs_ldr(void)
 {
-        xtables_register_target(&wg_obfs_reg);
+        xtables_register_targets(wg_obfs_reg,
+                                 sizeof(wg_obfs_reg) / sizeof(wg_obfs_reg[0]));
 }
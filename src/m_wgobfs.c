@@ -0,0 +1,299 @@
+/*
+ * tc plugin of the "wgobfs" action of the act_wgobfs module. tc loads
+ * m_wgobfs.so from its library directory, TC_LIB_DIR or /usr/lib/tc.
+ * configure --with-iproute2=DIR builds it against the headers of that
+ * iproute2 tree. Without it, the few tc and libnetlink declarations used are
+ * copied below, so it builds without the iproute2 sources.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <linux/types.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "tc_wgobfs.h"
+
+#ifdef HAVE_IPROUTE2
+#include "utils.h"
+#include "tc_util.h"
+#else
+#define FILTER_NAMESZ 16
+#define MAX_MSG 16384
+
+/* from tc/tc_util.h, include/utils.h and include/libnetlink.h of iproute2
+ * 6.1.0. tc finds the plugin by the symbol wgobfs_action_util and calls
+ * through it, a newer tc that changes struct action_util needs a build
+ * --with-iproute2.
+ */
+struct action_util {
+        struct action_util *next;
+        char id[FILTER_NAMESZ];
+        int (*parse_aopt)(struct action_util *a, int *argc, char ***argv,
+                          int code, struct nlmsghdr *n);
+        int (*print_aopt)(struct action_util *au, FILE *f,
+                          struct rtattr *opt);
+        int (*print_xstats)(struct action_util *au, FILE *f,
+                            struct rtattr *xstats);
+};
+
+extern int show_stats;
+int addattr_l(struct nlmsghdr *n, int maxlen, int type, const void *data,
+              int alen);
+int addattr32(struct nlmsghdr *n, int maxlen, int type, __u32 data);
+struct rtattr *addattr_nest(struct nlmsghdr *n, int maxlen, int type);
+int addattr_nest_end(struct nlmsghdr *n, struct rtattr *nest);
+int parse_rtattr(struct rtattr *tb[], int max, struct rtattr *rta, int len);
+int parse_action_control_dflt(int *argc_p, char ***argv_p, int *result_p,
+                              bool allow_num, int default_result);
+void print_action_control(FILE *f, const char *prefix, int action,
+                          const char *suffix);
+void print_tm(FILE *f, const struct tcf_t *tm);
+#endif /* HAVE_IPROUTE2 */
+
+static const char *const wg_obfs_prf_names[] = {
+        [XT_WGOBFS_PRF_CHACHA] = "chacha",
+        [XT_WGOBFS_PRF_SIPHASH] = "siphash",
+        [XT_WGOBFS_PRF_HSIPHASH] = "halfsiphash",
+        [XT_WGOBFS_PRF_AES] = "aes",
+};
+
+static const char *const wg_obfs_csum_names[] = {
+        [XT_WGOBFS_UDP_CSUM_KEEP] = "keep",
+        [XT_WGOBFS_UDP_CSUM_NONE] = "none",
+        [XT_WGOBFS_UDP_CSUM_SW] = "sw",
+};
+
+static const char *const wg_obfs_padding_names[] = {
+        [XT_WGOBFS_PADDING_COPY] = "copy",
+        [XT_WGOBFS_PADDING_FRAG] = "frag",
+};
+
+static void explain(void)
+{
+        fprintf(stderr,
+                "Usage: ... wgobfs key <string> obfs|unobfs [options]"
+                " [CONTROL] [index <n>]\n"
+                "options are those of the WGOBFS target:\n"
+                "    wire-ver <1|2> rounds <4|6|8|12>"
+                " prf <chacha|siphash|halfsiphash|aes>\n"
+                "    udp-csum <keep|none|sw> padding <copy|frag>"
+                " hs-limit <n> hs-burst <n>\n"
+                "CONTROL is reclassify|pipe|drop|continue|ok, pipe by"
+                " default\n");
+}
+
+static long parse_num(const char *s, long min, long max, const char *what)
+{
+        char *end;
+        long n;
+
+        errno = 0;
+        n = strtol(s, &end, 10);
+        if (errno || *end || end == s || n < min || n > max) {
+                fprintf(stderr, "wgobfs: bad %s %s\n", what, s);
+                return -1;
+        }
+
+        return n;
+}
+
+static int parse_name(const char *s, const char *const *names, int n,
+                      const char *what)
+{
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (!strcmp(s, names[i]))
+                        return i;
+
+        fprintf(stderr, "wgobfs: unknown %s %s\n", what, s);
+        return -1;
+}
+
+static const char *name_of(unsigned int i, const char *const *names, int n)
+{
+        return i < (unsigned int) n ? names[i] : "?";
+}
+
+static int parse_wgobfs(struct action_util *a, int *argc_p, char ***argv_p,
+                        int tca_id, struct nlmsghdr *n)
+{
+        static const char *const num_opts[] = {
+                "wire-ver", "rounds", "hs-limit", "hs-burst",
+        };
+        static const int num_attrs[] = {
+                TCA_WGOBFS_WIRE_VER, TCA_WGOBFS_ROUNDS,
+                TCA_WGOBFS_HS_RATE, TCA_WGOBFS_HS_BURST,
+        };
+        static const long num_min[] = { XT_WGOBFS_WIRE_V1, 4, 1, 1 };
+        static const long num_max[] = {
+                XT_WGOBFS_WIRE_V2, 12, XT_WGOBFS_HS_MAX, XT_WGOBFS_HS_MAX,
+        };
+        long nums[4] = { -1, -1, -1, -1 };
+        int prf = -1, udp_csum = -1, padding = -1, mode = -1;
+        struct tc_wgobfs p = { .action = TC_ACT_PIPE };
+        const char *key = NULL;
+        char **argv = *argv_p;
+        int argc = *argc_p;
+        struct rtattr *tail;
+        unsigned int i;
+        char *end;
+
+        if (argc <= 0 || strcmp(*argv, "wgobfs"))
+                return -1;
+        argc--;
+        argv++;
+
+        while (argc > 0) {
+                if (!strcmp(*argv, "obfs") || !strcmp(*argv, "unobfs")) {
+                        mode = **argv == 'u' ? XT_MODE_UNOBFS : XT_MODE_OBFS;
+                        argc--;
+                        argv++;
+                        continue;
+                } else if (!strcmp(*argv, "help")) {
+                        explain();
+                        return -1;
+                } else if (argc < 2) {
+                        break;
+                } else if (!strcmp(*argv, "key")) {
+                        key = argv[1];
+                        if (!*key || strlen(key) > XT_WGOBFS_MAX_KEY_SIZE) {
+                                fprintf(stderr,
+                                        "wgobfs: the key is 1 to 32 characters\n");
+                                return -1;
+                        }
+                } else if (!strcmp(*argv, "prf")) {
+                        prf = parse_name(argv[1], wg_obfs_prf_names,
+                                         XT_WGOBFS_PRF_AES + 1, "prf");
+                        if (prf < 0)
+                                return -1;
+                } else if (!strcmp(*argv, "udp-csum")) {
+                        udp_csum = parse_name(argv[1], wg_obfs_csum_names,
+                                              XT_WGOBFS_UDP_CSUM_SW + 1,
+                                              "udp-csum");
+                        if (udp_csum < 0)
+                                return -1;
+                } else if (!strcmp(*argv, "padding")) {
+                        padding = parse_name(argv[1], wg_obfs_padding_names,
+                                             XT_WGOBFS_PADDING_FRAG + 1,
+                                             "padding");
+                        if (padding < 0)
+                                return -1;
+                } else {
+                        for (i = 0; i < 4; i++)
+                                if (!strcmp(*argv, num_opts[i]))
+                                        break;
+                        if (i == 4)
+                                break;
+                        nums[i] = parse_num(argv[1], num_min[i], num_max[i],
+                                            num_opts[i]);
+                        if (nums[i] < 0)
+                                return -1;
+                }
+                argc -= 2;
+                argv += 2;
+        }
+
+        if (!key || mode < 0) {
+                explain();
+                return -1;
+        }
+        if (nums[1] >= 0 && (nums[1] & 1 || nums[1] == 10)) {
+                fprintf(stderr, "wgobfs: rounds must be 4, 6, 8 or 12\n");
+                return -1;
+        }
+        if (nums[3] >= 0 && nums[2] < 0) {
+                fprintf(stderr, "wgobfs: hs-burst needs hs-limit\n");
+                return -1;
+        }
+        if (nums[2] >= 0 && mode != XT_MODE_UNOBFS) {
+                fprintf(stderr, "wgobfs: hs-limit only works with unobfs\n");
+                return -1;
+        }
+
+        parse_action_control_dflt(&argc, &argv, &p.action, false,
+                                  TC_ACT_PIPE);
+        if (argc > 1 && !strcmp(*argv, "index")) {
+                p.index = strtoul(argv[1], &end, 0);
+                if (*end || !*argv[1]) {
+                        fprintf(stderr, "wgobfs: bad index %s\n", argv[1]);
+                        return -1;
+                }
+                argc -= 2;
+                argv += 2;
+        }
+
+        tail = addattr_nest(n, MAX_MSG, tca_id);
+        addattr_l(n, MAX_MSG, TCA_WGOBFS_PARMS, &p, sizeof(p));
+        addattr_l(n, MAX_MSG, TCA_WGOBFS_KEY, key, strlen(key) + 1);
+        addattr32(n, MAX_MSG, TCA_WGOBFS_MODE, mode);
+        for (i = 0; i < 4; i++)
+                if (nums[i] >= 0)
+                        addattr32(n, MAX_MSG, num_attrs[i], nums[i]);
+        if (prf >= 0)
+                addattr32(n, MAX_MSG, TCA_WGOBFS_PRF, prf);
+        if (udp_csum >= 0)
+                addattr32(n, MAX_MSG, TCA_WGOBFS_UDP_CSUM, udp_csum);
+        if (padding >= 0)
+                addattr32(n, MAX_MSG, TCA_WGOBFS_PADDING, padding);
+        addattr_nest_end(n, tail);
+
+        *argc_p = argc;
+        *argv_p = argv;
+        return 0;
+}
+
+static __u32 rta_u32(struct rtattr *rta)
+{
+        return rta ? *(__u32 *) RTA_DATA(rta) : 0;
+}
+
+static int print_wgobfs(struct action_util *au, FILE *f, struct rtattr *arg)
+{
+        struct rtattr *tb[TCA_WGOBFS_MAX + 1] = { NULL };
+        struct tc_wgobfs *p;
+
+        if (!arg)
+                return 0;
+
+        parse_rtattr(tb, TCA_WGOBFS_MAX, RTA_DATA(arg), RTA_PAYLOAD(arg));
+        if (!tb[TCA_WGOBFS_PARMS] || !tb[TCA_WGOBFS_KEY]) {
+                fprintf(stderr, "Missing wgobfs parameters\n");
+                return -1;
+        }
+        p = RTA_DATA(tb[TCA_WGOBFS_PARMS]);
+
+        fprintf(f, "wgobfs key %s %s wire-ver %u rounds %u prf %s"
+                " udp-csum %s padding %s",
+                (char *) RTA_DATA(tb[TCA_WGOBFS_KEY]),
+                rta_u32(tb[TCA_WGOBFS_MODE]) ? "unobfs" : "obfs",
+                rta_u32(tb[TCA_WGOBFS_WIRE_VER]),
+                rta_u32(tb[TCA_WGOBFS_ROUNDS]),
+                name_of(rta_u32(tb[TCA_WGOBFS_PRF]), wg_obfs_prf_names,
+                        XT_WGOBFS_PRF_AES + 1),
+                name_of(rta_u32(tb[TCA_WGOBFS_UDP_CSUM]), wg_obfs_csum_names,
+                        XT_WGOBFS_UDP_CSUM_SW + 1),
+                name_of(rta_u32(tb[TCA_WGOBFS_PADDING]),
+                        wg_obfs_padding_names, XT_WGOBFS_PADDING_FRAG + 1));
+        if (tb[TCA_WGOBFS_HS_RATE])
+                fprintf(f, " hs-limit %u hs-burst %u",
+                        rta_u32(tb[TCA_WGOBFS_HS_RATE]),
+                        rta_u32(tb[TCA_WGOBFS_HS_BURST]));
+        print_action_control(f, " ", p->action, "");
+
+        fprintf(f, "\n\t index %u ref %d bind %d rule %u", p->index,
+                p->refcnt, p->bindcnt, rta_u32(tb[TCA_WGOBFS_ID]));
+        if (show_stats && tb[TCA_WGOBFS_TM])
+                print_tm(f, RTA_DATA(tb[TCA_WGOBFS_TM]));
+        fprintf(f, "\n");
+
+        return 0;
+}
+
+struct action_util wgobfs_action_util = {
+        .id = "wgobfs",
+        .parse_aopt = parse_wgobfs,
+        .print_aopt = print_wgobfs,
+};
@@ -0,0 +1,646 @@
+/*
+ * Add, list and delete nftables rules with the wgobfs expression of the
+ * xt_WGOBFS module, until nft knows the expression itself. It talks
+ * nfnetlink directly and needs only the kernel headers.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+#include "xt_WGOBFS.h"
+
+#define BUF_SIZE 65536
+
+enum {
+        OPT_KEY = 0,
+        OPT_OBFS,
+        OPT_UNOBFS,
+        OPT_WIRE_VER,
+        OPT_ROUNDS,
+        OPT_PRF,
+        OPT_UDP_CSUM,
+        OPT_PADDING,
+        OPT_HS_LIMIT,
+        OPT_HS_BURST,
+        OPT_SPORT,
+        OPT_DPORT
+};
+
+static const struct option wg_obfs_opts[] = {
+        {.name = "key",.has_arg = true,.val = OPT_KEY },
+        {.name = "obfs",.has_arg = false,.val = OPT_OBFS },
+        {.name = "unobfs",.has_arg = false,.val = OPT_UNOBFS },
+        {.name = "wire-ver",.has_arg = true,.val = OPT_WIRE_VER },
+        {.name = "rounds",.has_arg = true,.val = OPT_ROUNDS },
+        {.name = "prf",.has_arg = true,.val = OPT_PRF },
+        {.name = "udp-csum",.has_arg = true,.val = OPT_UDP_CSUM },
+        {.name = "padding",.has_arg = true,.val = OPT_PADDING },
+        {.name = "hs-limit",.has_arg = true,.val = OPT_HS_LIMIT },
+        {.name = "hs-burst",.has_arg = true,.val = OPT_HS_BURST },
+        {.name = "sport",.has_arg = true,.val = OPT_SPORT },
+        {.name = "dport",.has_arg = true,.val = OPT_DPORT },
+        { },
+};
+
+static const char *const wg_obfs_prf_names[] = {
+        [XT_WGOBFS_PRF_CHACHA] = "chacha",
+        [XT_WGOBFS_PRF_SIPHASH] = "siphash",
+        [XT_WGOBFS_PRF_HSIPHASH] = "halfsiphash",
+        [XT_WGOBFS_PRF_AES] = "aes",
+};
+
+static const char *const wg_obfs_csum_names[] = {
+        [XT_WGOBFS_UDP_CSUM_KEEP] = "keep",
+        [XT_WGOBFS_UDP_CSUM_NONE] = "none",
+        [XT_WGOBFS_UDP_CSUM_SW] = "sw",
+};
+
+static const char *const wg_obfs_padding_names[] = {
+        [XT_WGOBFS_PADDING_COPY] = "copy",
+        [XT_WGOBFS_PADDING_FRAG] = "frag",
+};
+
+/* the rule to add, -1 for an option not given */
+struct wg_obfs_rule {
+        const char *key;
+        int mode;
+        int wire_ver;
+        int rounds;
+        int prf;
+        int udp_csum;
+        int padding;
+        long hs_rate;
+        long hs_burst;
+        int port;
+        int port_off;   /* 0 sport, 2 dport */
+};
+
+struct nl_buf {
+        char data[BUF_SIZE];
+        size_t len;
+};
+
+static const char *prog;
+static int nl_fd;
+static uint32_t nl_seq;
+
+static void usage(void)
+{
+        fprintf(stderr,
+                "usage: %s add <family> <table> <chain> [--sport|--dport <port>]\n"
+                "           --key <string> --obfs|--unobfs [options]\n"
+                "       %s list <family> <table> <chain>\n"
+                "       %s delete <family> <table> <chain> <handle>\n"
+                "family is ip, inet or netdev, the options are those of the"
+                " WGOBFS target:\n"
+                "    --wire-ver <1|2> --rounds <4|6|8|12>"
+                " --prf <chacha|siphash|halfsiphash|aes>\n"
+                "    --udp-csum <keep|none|sw> --padding <copy|frag>"
+                " --hs-limit <n> --hs-burst <n>\n",
+                prog, prog, prog);
+        exit(2);
+}
+
+static void die(const char *msg)
+{
+        fprintf(stderr, "nft-wgobfs: %s\n", msg);
+        exit(1);
+}
+
+static int parse_family(const char *s)
+{
+        if (!strcmp(s, "ip"))
+                return NFPROTO_IPV4;
+        if (!strcmp(s, "inet"))
+                return NFPROTO_INET;
+        if (!strcmp(s, "netdev"))
+                return NFPROTO_NETDEV;
+
+        die("family must be ip, inet or netdev");
+        return -1;
+}
+
+static long parse_num(const char *s, long min, long max, const char *what)
+{
+        char *end;
+        long n;
+
+        errno = 0;
+        n = strtol(s, &end, 10);
+        if (errno || *end || end == s || n < min || n > max) {
+                fprintf(stderr, "nft-wgobfs: bad %s %s\n", what, s);
+                exit(2);
+        }
+
+        return n;
+}
+
+static int parse_name(const char *s, const char *const *names, int n,
+                      const char *what)
+{
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (!strcmp(s, names[i]))
+                        return i;
+
+        fprintf(stderr, "nft-wgobfs: unknown %s %s\n", what, s);
+        exit(2);
+}
+
+static struct nlmsghdr *nl_msg(struct nl_buf *b, uint16_t type,
+                               uint16_t flags, uint8_t family,
+                               uint16_t res_id)
+{
+        struct nlmsghdr *nlh = (void *) (b->data + b->len);
+        struct nfgenmsg *nfg;
+
+        nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*nfg));
+        nlh->nlmsg_type = type;
+        nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+        nlh->nlmsg_seq = ++nl_seq;
+        nlh->nlmsg_pid = 0;
+        nfg = NLMSG_DATA(nlh);
+        nfg->nfgen_family = family;
+        nfg->version = NFNETLINK_V0;
+        nfg->res_id = htons(res_id);
+        return nlh;
+}
+
+static void nl_end(struct nl_buf *b, struct nlmsghdr *nlh)
+{
+        b->len += NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+static struct nlattr *nl_put(struct nlmsghdr *nlh, uint16_t type,
+                             const void *data, size_t len)
+{
+        struct nlattr *nla = (void *) ((char *) nlh +
+                                       NLMSG_ALIGN(nlh->nlmsg_len));
+
+        if (NLMSG_ALIGN(nlh->nlmsg_len) + NLA_HDRLEN + NLA_ALIGN(len) >
+            BUF_SIZE / 2)
+                die("message too long");
+
+        nla->nla_type = type;
+        nla->nla_len = NLA_HDRLEN + len;
+        memcpy((char *) nla + NLA_HDRLEN, data, len);
+        memset((char *) nla + NLA_HDRLEN + len, 0, NLA_ALIGN(len) - len);
+        nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+        return nla;
+}
+
+static void nl_put_str(struct nlmsghdr *nlh, uint16_t type, const char *s)
+{
+        nl_put(nlh, type, s, strlen(s) + 1);
+}
+
+static void nl_put_u32(struct nlmsghdr *nlh, uint16_t type, uint32_t v)
+{
+        v = htonl(v);
+        nl_put(nlh, type, &v, sizeof(v));
+}
+
+static struct nlattr *nl_nest(struct nlmsghdr *nlh, uint16_t type)
+{
+        return nl_put(nlh, type | NLA_F_NESTED, NULL, 0);
+}
+
+static void nl_nest_end(struct nlmsghdr *nlh, struct nlattr *nest)
+{
+        nest->nla_len = (char *) nlh + nlh->nlmsg_len - (char *) nest;
+}
+
+/* an expression whose attributes are all u32, terminated by -1 */
+static void put_expr(struct nlmsghdr *nlh, const char *name, ...)
+{
+        struct nlattr *elem, *data;
+        va_list ap;
+        int type;
+
+        elem = nl_nest(nlh, NFTA_LIST_ELEM);
+        nl_put_str(nlh, NFTA_EXPR_NAME, name);
+        data = nl_nest(nlh, NFTA_EXPR_DATA);
+        va_start(ap, name);
+        while ((type = va_arg(ap, int)) >= 0)
+                nl_put_u32(nlh, type, va_arg(ap, uint32_t));
+        va_end(ap);
+        nl_nest_end(nlh, data);
+        nl_nest_end(nlh, elem);
+}
+
+static void put_cmp_eq(struct nlmsghdr *nlh, const void *val, size_t len)
+{
+        struct nlattr *elem, *data, *cmp;
+
+        elem = nl_nest(nlh, NFTA_LIST_ELEM);
+        nl_put_str(nlh, NFTA_EXPR_NAME, "cmp");
+        data = nl_nest(nlh, NFTA_EXPR_DATA);
+        nl_put_u32(nlh, NFTA_CMP_SREG, NFT_REG_1);
+        nl_put_u32(nlh, NFTA_CMP_OP, NFT_CMP_EQ);
+        cmp = nl_nest(nlh, NFTA_CMP_DATA);
+        nl_put(nlh, NFTA_DATA_VALUE, val, len);
+        nl_nest_end(nlh, cmp);
+        nl_nest_end(nlh, data);
+        nl_nest_end(nlh, elem);
+}
+
+static void put_wgobfs(struct nlmsghdr *nlh, const struct wg_obfs_rule *r)
+{
+        struct nlattr *elem, *data;
+
+        elem = nl_nest(nlh, NFTA_LIST_ELEM);
+        nl_put_str(nlh, NFTA_EXPR_NAME, "wgobfs");
+        data = nl_nest(nlh, NFTA_EXPR_DATA);
+        nl_put_str(nlh, NFTA_WGOBFS_KEY, r->key);
+        nl_put_u32(nlh, NFTA_WGOBFS_MODE, r->mode);
+        if (r->wire_ver >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_WIRE_VER, r->wire_ver);
+        if (r->rounds >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_ROUNDS, r->rounds);
+        if (r->prf >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_PRF, r->prf);
+        if (r->udp_csum >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_UDP_CSUM, r->udp_csum);
+        if (r->padding >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_PADDING, r->padding);
+        if (r->hs_rate >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_HS_RATE, r->hs_rate);
+        if (r->hs_burst >= 0)
+                nl_put_u32(nlh, NFTA_WGOBFS_HS_BURST, r->hs_burst);
+        nl_nest_end(nlh, data);
+        nl_nest_end(nlh, elem);
+}
+
+static void nl_open(void)
+{
+        struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+
+        nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+        if (nl_fd < 0 || bind(nl_fd, (struct sockaddr *) &sa, sizeof(sa))) {
+                perror("nft-wgobfs: netlink");
+                exit(1);
+        }
+}
+
+static void nl_send(const struct nl_buf *b)
+{
+        struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+
+        if (sendto(nl_fd, b->data, b->len, 0, (struct sockaddr *) &sa,
+                   sizeof(sa)) != (ssize_t) b->len) {
+                perror("nft-wgobfs: send");
+                exit(1);
+        }
+}
+
+static void parse_attrs(const struct nlattr *nla, int len,
+                        const struct nlattr **tb, int max)
+{
+        memset(tb, 0, sizeof(*tb) * (max + 1));
+        while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+               nla->nla_len <= len) {
+                int type = nla->nla_type & NLA_TYPE_MASK;
+
+                if (type <= max)
+                        tb[type] = nla;
+                len -= NLA_ALIGN(nla->nla_len);
+                nla = (const void *) ((const char *) nla +
+                                      NLA_ALIGN(nla->nla_len));
+        }
+}
+
+#define nla_data(nla) ((const void *) ((const char *) (nla) + NLA_HDRLEN))
+#define nla_len(nla) ((nla)->nla_len - NLA_HDRLEN)
+
+static uint32_t nla_u32(const struct nlattr *nla)
+{
+        uint32_t v;
+
+        memcpy(&v, nla_data(nla), sizeof(v));
+        return ntohl(v);
+}
+
+static uint64_t nla_u64(const struct nlattr *nla)
+{
+        uint64_t v;
+
+        memcpy(&v, nla_data(nla), sizeof(v));
+        return be64toh(v);
+}
+
+static void print_wgobfs(const struct nlattr *data)
+{
+        const struct nlattr *tb[NFTA_WGOBFS_MAX + 1];
+        uint32_t v;
+
+        parse_attrs(nla_data(data), nla_len(data), tb, NFTA_WGOBFS_MAX);
+        if (tb[NFTA_WGOBFS_KEY])
+                printf(" --key %.*s", (int) nla_len(tb[NFTA_WGOBFS_KEY]),
+                       (const char *) nla_data(tb[NFTA_WGOBFS_KEY]));
+        if (tb[NFTA_WGOBFS_MODE])
+                printf(nla_u32(tb[NFTA_WGOBFS_MODE]) == XT_MODE_OBFS ?
+                       " --obfs" : " --unobfs");
+        if (tb[NFTA_WGOBFS_WIRE_VER] &&
+            (v = nla_u32(tb[NFTA_WGOBFS_WIRE_VER])) != XT_WGOBFS_WIRE_V1)
+                printf(" --wire-ver %u", v);
+        if (tb[NFTA_WGOBFS_ROUNDS] &&
+            (v = nla_u32(tb[NFTA_WGOBFS_ROUNDS])) != XT_WGOBFS_DEFAULT_ROUNDS)
+                printf(" --rounds %u", v);
+        if (tb[NFTA_WGOBFS_PRF] &&
+            (v = nla_u32(tb[NFTA_WGOBFS_PRF])) != XT_WGOBFS_PRF_CHACHA &&
+            v <= XT_WGOBFS_PRF_AES)
+                printf(" --prf %s", wg_obfs_prf_names[v]);
+        if (tb[NFTA_WGOBFS_UDP_CSUM] &&
+            (v = nla_u32(tb[NFTA_WGOBFS_UDP_CSUM])) != XT_WGOBFS_UDP_CSUM_KEEP &&
+            v <= XT_WGOBFS_UDP_CSUM_SW)
+                printf(" --udp-csum %s", wg_obfs_csum_names[v]);
+        if (tb[NFTA_WGOBFS_PADDING] &&
+            nla_u32(tb[NFTA_WGOBFS_PADDING]) == XT_WGOBFS_PADDING_FRAG)
+                printf(" --padding frag");
+        if (tb[NFTA_WGOBFS_HS_RATE])
+                printf(" --hs-limit %u --hs-burst %u",
+                       nla_u32(tb[NFTA_WGOBFS_HS_RATE]),
+                       tb[NFTA_WGOBFS_HS_BURST] ?
+                       nla_u32(tb[NFTA_WGOBFS_HS_BURST]) : XT_WGOBFS_HS_BURST);
+        if (tb[NFTA_WGOBFS_ID])
+                printf(" id %u", nla_u32(tb[NFTA_WGOBFS_ID]));
+}
+
+/* one line per rule, the other expressions by name only */
+static void print_rule(const struct nlmsghdr *nlh)
+{
+        const struct nlattr *tb[NFTA_RULE_MAX + 1];
+        const struct nlattr *etb[NFTA_EXPR_MAX + 1];
+        const struct nlattr *elem;
+        int len;
+
+        parse_attrs((const void *) ((const char *) NLMSG_DATA(nlh) +
+                                    NLMSG_ALIGN(sizeof(struct nfgenmsg))),
+                    nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct nfgenmsg)),
+                    tb, NFTA_RULE_MAX);
+        if (!tb[NFTA_RULE_HANDLE])
+                return;
+
+        printf("handle %llu:",
+               (unsigned long long) nla_u64(tb[NFTA_RULE_HANDLE]));
+        if (tb[NFTA_RULE_EXPRESSIONS]) {
+                elem = nla_data(tb[NFTA_RULE_EXPRESSIONS]);
+                len = nla_len(tb[NFTA_RULE_EXPRESSIONS]);
+                while (len >= NLA_HDRLEN && elem->nla_len >= NLA_HDRLEN &&
+                       elem->nla_len <= len) {
+                        parse_attrs(nla_data(elem), nla_len(elem), etb,
+                                    NFTA_EXPR_MAX);
+                        if (etb[NFTA_EXPR_NAME]) {
+                                const char *name = nla_data(etb[NFTA_EXPR_NAME]);
+
+                                if (!strcmp(name, "wgobfs") &&
+                                    etb[NFTA_EXPR_DATA]) {
+                                        printf(" wgobfs");
+                                        print_wgobfs(etb[NFTA_EXPR_DATA]);
+                                } else {
+                                        printf(" %s", name);
+                                }
+                        }
+                        len -= NLA_ALIGN(elem->nla_len);
+                        elem = (const void *) ((const char *) elem +
+                                               NLA_ALIGN(elem->nla_len));
+                }
+        }
+        printf("\n");
+}
+
+/* read the replies up to the ack of @last_seq, or the end of a dump */
+static int nl_recv(uint32_t last_seq, int print_rules)
+{
+        static char buf[BUF_SIZE];
+        const struct nlmsghdr *nlh;
+        const struct nlmsgerr *err;
+        ssize_t n;
+        int len;
+
+        for (;;) {
+                n = recv(nl_fd, buf, sizeof(buf), 0);
+                if (n < 0) {
+                        perror("nft-wgobfs: recv");
+                        return -1;
+                }
+
+                len = n;
+                for (nlh = (void *) buf; NLMSG_OK(nlh, len);
+                     nlh = NLMSG_NEXT(nlh, len)) {
+                        if (nlh->nlmsg_type == NLMSG_DONE)
+                                return 0;
+
+                        if (nlh->nlmsg_type == NLMSG_ERROR) {
+                                err = NLMSG_DATA(nlh);
+                                if (err->error) {
+                                        fprintf(stderr, "nft-wgobfs: %s\n",
+                                                strerror(-err->error));
+                                        return -1;
+                                }
+                                if (nlh->nlmsg_seq == last_seq)
+                                        return 0;
+                                continue;
+                        }
+
+                        if ((nlh->nlmsg_type & 0xff) == NFT_MSG_NEWRULE &&
+                            print_rules)
+                                print_rule(nlh);
+                }
+        }
+}
+
+/* a batch with one rule message, which the caller fills and ends */
+static void nl_batch(struct nl_buf *b, uint16_t type, uint16_t flags,
+                    uint8_t family, const char *table, const char *chain,
+                    struct nlmsghdr **rule)
+{
+        struct nlmsghdr *nlh;
+
+        nlh = nl_msg(b, NFNL_MSG_BATCH_BEGIN, 0, AF_UNSPEC,
+                     NFNL_SUBSYS_NFTABLES);
+        nl_end(b, nlh);
+
+        *rule = nl_msg(b, (NFNL_SUBSYS_NFTABLES << 8) | type,
+                       NLM_F_ACK | flags, family, 0);
+        nl_put_str(*rule, NFTA_RULE_TABLE, table);
+        nl_put_str(*rule, NFTA_RULE_CHAIN, chain);
+}
+
+static int nl_batch_end(struct nl_buf *b, struct nlmsghdr *rule)
+{
+        struct nlmsghdr *nlh;
+        uint32_t seq = rule->nlmsg_seq;
+
+        nl_end(b, rule);
+        nlh = nl_msg(b, NFNL_MSG_BATCH_END, 0, AF_UNSPEC, NFNL_SUBSYS_NFTABLES);
+        nl_end(b, nlh);
+        nl_send(b);
+        return nl_recv(seq, true);
+}
+
+static int cmd_add(int argc, char **argv)
+{
+        struct wg_obfs_rule r = {
+                .mode = -1, .wire_ver = -1, .rounds = -1, .prf = -1,
+                .udp_csum = -1, .padding = -1, .hs_rate = -1, .hs_burst = -1,
+                .port = -1,
+        };
+        static struct nl_buf b;
+        struct nlmsghdr *rule;
+        struct nlattr *exprs;
+        uint8_t family, l4proto = IPPROTO_UDP;
+        uint16_t port;
+        int c;
+
+        family = parse_family(argv[1]);
+        optind = 4;
+        while ((c = getopt_long(argc, argv, "", wg_obfs_opts, NULL)) != -1) {
+                switch (c) {
+                case OPT_KEY:
+                        if (!*optarg || strlen(optarg) > XT_WGOBFS_MAX_KEY_SIZE)
+                                die("the key is 1 to 32 characters");
+                        r.key = optarg;
+                        break;
+                case OPT_OBFS:
+                        r.mode = XT_MODE_OBFS;
+                        break;
+                case OPT_UNOBFS:
+                        r.mode = XT_MODE_UNOBFS;
+                        break;
+                case OPT_WIRE_VER:
+                        r.wire_ver = parse_num(optarg, XT_WGOBFS_WIRE_V1,
+                                               XT_WGOBFS_WIRE_V2, "wire-ver");
+                        break;
+                case OPT_ROUNDS:
+                        r.rounds = parse_num(optarg, 4, 12, "rounds");
+                        if (r.rounds & 1 || r.rounds == 10)
+                                die("--rounds must be 4, 6, 8 or 12");
+                        break;
+                case OPT_PRF:
+                        r.prf = parse_name(optarg, wg_obfs_prf_names,
+                                           XT_WGOBFS_PRF_AES + 1, "prf");
+                        break;
+                case OPT_UDP_CSUM:
+                        r.udp_csum = parse_name(optarg, wg_obfs_csum_names,
+                                                XT_WGOBFS_UDP_CSUM_SW + 1,
+                                                "udp-csum");
+                        break;
+                case OPT_PADDING:
+                        r.padding = parse_name(optarg, wg_obfs_padding_names,
+                                               XT_WGOBFS_PADDING_FRAG + 1,
+                                               "padding");
+                        break;
+                case OPT_HS_LIMIT:
+                        r.hs_rate = parse_num(optarg, 1, XT_WGOBFS_HS_MAX,
+                                              "hs-limit");
+                        break;
+                case OPT_HS_BURST:
+                        r.hs_burst = parse_num(optarg, 1, XT_WGOBFS_HS_MAX,
+                                               "hs-burst");
+                        break;
+                case OPT_SPORT:
+                case OPT_DPORT:
+                        r.port = parse_num(optarg, 1, 65535, "port");
+                        r.port_off = c == OPT_SPORT ? 0 : 2;
+                        break;
+                default:
+                        usage();
+                }
+        }
+
+        if (optind != argc || !r.key || r.mode < 0)
+                usage();
+        if (r.hs_burst >= 0 && r.hs_rate < 0)
+                die("--hs-burst needs --hs-limit");
+        if (r.hs_rate >= 0 && r.mode != XT_MODE_UNOBFS)
+                die("--hs-limit only works with --unobfs");
+
+        nl_batch(&b, NFT_MSG_NEWRULE, NLM_F_CREATE | NLM_F_APPEND | NLM_F_ECHO,
+                 family, argv[2], argv[3], &rule);
+        exprs = nl_nest(rule, NFTA_RULE_EXPRESSIONS);
+        /* meta l4proto udp [udp sport|dport <port>] */
+        put_expr(rule, "meta", NFTA_META_DREG, NFT_REG_1,
+                 NFTA_META_KEY, NFT_META_L4PROTO, -1);
+        put_cmp_eq(rule, &l4proto, sizeof(l4proto));
+        if (r.port >= 0) {
+                port = htons(r.port);
+                put_expr(rule, "payload", NFTA_PAYLOAD_DREG, NFT_REG_1,
+                         NFTA_PAYLOAD_BASE, NFT_PAYLOAD_TRANSPORT_HEADER,
+                         NFTA_PAYLOAD_OFFSET, r.port_off,
+                         NFTA_PAYLOAD_LEN, (int) sizeof(port), -1);
+                put_cmp_eq(rule, &port, sizeof(port));
+        }
+        put_wgobfs(rule, &r);
+        nl_nest_end(rule, exprs);
+        return nl_batch_end(&b, rule);
+}
+
+static int cmd_delete(int argc, char **argv)
+{
+        static struct nl_buf b;
+        struct nlmsghdr *rule;
+        uint64_t handle;
+
+        if (argc != 5)
+                usage();
+
+        handle = htobe64(parse_num(argv[4], 1, INT64_MAX, "handle"));
+        nl_batch(&b, NFT_MSG_DELRULE, 0, parse_family(argv[1]), argv[2],
+                 argv[3], &rule);
+        nl_put(rule, NFTA_RULE_HANDLE, &handle, sizeof(handle));
+        return nl_batch_end(&b, rule);
+}
+
+static int cmd_list(int argc, char **argv)
+{
+        static struct nl_buf b;
+        struct nlmsghdr *nlh;
+
+        if (argc != 4)
+                usage();
+
+        nlh = nl_msg(&b, (NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_GETRULE,
+                     NLM_F_DUMP, parse_family(argv[1]), 0);
+        nl_put_str(nlh, NFTA_RULE_TABLE, argv[2]);
+        nl_put_str(nlh, NFTA_RULE_CHAIN, argv[3]);
+        nl_end(&b, nlh);
+        nl_send(&b);
+        return nl_recv(0, true);
+}
+
+int main(int argc, char **argv)
+{
+        int ret;
+
+        prog = argv[0];
+        if (argc < 4)
+                usage();
+
+        nl_open();
+        /* the commands see their name as argv[0] */
+        if (!strcmp(argv[1], "add"))
+                ret = cmd_add(argc - 1, argv + 1);
+        else if (!strcmp(argv[1], "list"))
+                ret = cmd_list(argc - 1, argv + 1);
+        else if (!strcmp(argv[1], "delete"))
+                ret = cmd_delete(argc - 1, argv + 1);
+        else
+                usage();
+
+        close(nl_fd);
+        return ret ? 1 : 0;
+}
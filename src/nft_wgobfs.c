@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * The nftables expression "wgobfs". It runs the transform of the WGOBFS
+ * target from ip, inet and netdev chains, without the per packet work of the
+ * xtables compat layer. The options are those of revision 1, passed as
+ * NFTA_WGOBFS_* attributes, and each expression has its own counters.
+ *
+ * It is a module of its own, nft_wgobfs.ko, so the iptables target does not
+ * pull in nf_tables. The transform is the one exported by xt_WGOBFS.ko.
+ */
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+#include "obfs.h"
+
+/* the netdev family and the register based expressions need 4.2 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+#define nft_wgobfs_family(ctx) ((ctx)->family)
+#else
+#define nft_wgobfs_family(ctx) ((ctx)->afi->family)
+#endif
+
+static const struct nla_policy nft_wgobfs_policy[NFTA_WGOBFS_MAX + 1] = {
+	[NFTA_WGOBFS_KEY]	= { .type = NLA_STRING,
+				    .len = XT_WGOBFS_MAX_KEY_SIZE },
+	[NFTA_WGOBFS_MODE]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_WIRE_VER]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_ROUNDS]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_PRF]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_UDP_CSUM]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_PADDING]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_HS_RATE]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_HS_BURST]	= { .type = NLA_U32 },
+	[NFTA_WGOBFS_ID]	= { .type = NLA_U32 },
+};
+
+static void nft_wgobfs_eval(const struct nft_expr *expr,
+			    struct nft_regs *regs,
+			    const struct nft_pktinfo *pkt)
+{
+	const struct xt_wg_obfs_info_v1 *info = nft_expr_priv(expr);
+	struct sk_buff *skb = pkt->skb;
+	const int nhoff = skb_network_offset(skb);
+
+	if (!wg_obfs_skb_udp4(skb, nhoff))
+		return;
+
+	/* the transform expects the IP header at skb->data, which is not the
+	 * case on netdev egress, and BH disabled for its per CPU state, as
+	 * ipt_do_table() does but nft_do_chain() does not
+	 */
+	__skb_pull(skb, nhoff);
+	local_bh_disable();
+	if (wg_obfs_target(skb, info->mode, info->ctx) == NF_DROP)
+		regs->verdict.code = NF_DROP;
+	local_bh_enable();
+	__skb_push(skb, nhoff);
+}
+
+static int nft_wgobfs_get_u8(const struct nlattr *attr, u8 *v)
+{
+	u32 n;
+
+	if (!attr)
+		return 0;
+
+	n = ntohl(nla_get_be32(attr));
+	if (n > U8_MAX)
+		return -ERANGE;
+
+	*v = n;
+	return 0;
+}
+
+static int nft_wgobfs_init(const struct nft_ctx *ctx,
+			   const struct nft_expr *expr,
+			   const struct nlattr * const tb[])
+{
+	struct xt_wg_obfs_info_v1 *info = nft_expr_priv(expr);
+	int ret;
+
+	switch (nft_wgobfs_family(ctx)) {
+	case NFPROTO_IPV4:
+	case NFPROTO_INET:
+	case NFPROTO_NETDEV:
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	if (!tb[NFTA_WGOBFS_KEY] || !tb[NFTA_WGOBFS_MODE])
+		return -EINVAL;
+
+	wg_obfs_info_init(info);
+	ret = wg_obfs_info_set_key(info, nla_data(tb[NFTA_WGOBFS_KEY]),
+				   strnlen(nla_data(tb[NFTA_WGOBFS_KEY]),
+					   nla_len(tb[NFTA_WGOBFS_KEY])));
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_MODE], &info->mode);
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_WIRE_VER],
+					&info->wire_ver);
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_ROUNDS], &info->rounds);
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_PRF], &info->prf);
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_UDP_CSUM],
+					&info->udp_csum);
+	if (!ret)
+		ret = nft_wgobfs_get_u8(tb[NFTA_WGOBFS_PADDING],
+					&info->padding);
+	if (ret)
+		return ret;
+
+	if (tb[NFTA_WGOBFS_HS_RATE])
+		info->hs_rate = ntohl(nla_get_be32(tb[NFTA_WGOBFS_HS_RATE]));
+	if (tb[NFTA_WGOBFS_HS_BURST])
+		info->hs_burst = ntohl(nla_get_be32(tb[NFTA_WGOBFS_HS_BURST]));
+
+	ret = wg_obfs_info_check(info);
+	if (ret)
+		return ret;
+
+	return wg_obfs_ctx_create(ctx->net, info);
+}
+
+static void nft_wgobfs_destroy(const struct nft_ctx *ctx,
+			       const struct nft_expr *expr)
+{
+	const struct xt_wg_obfs_info_v1 *info = nft_expr_priv(expr);
+
+	wg_obfs_ctx_destroy(info->ctx);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+static int nft_wgobfs_dump(struct sk_buff *skb, const struct nft_expr *expr,
+			   bool reset)
+#else
+static int nft_wgobfs_dump(struct sk_buff *skb, const struct nft_expr *expr)
+#endif
+{
+	const struct xt_wg_obfs_info_v1 *info = nft_expr_priv(expr);
+
+	if (nla_put_string(skb, NFTA_WGOBFS_KEY, info->key) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_MODE, htonl(info->mode)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_WIRE_VER, htonl(info->wire_ver)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_ROUNDS, htonl(info->rounds)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_PRF, htonl(info->prf)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_UDP_CSUM, htonl(info->udp_csum)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_PADDING, htonl(info->padding)) ||
+	    nla_put_be32(skb, NFTA_WGOBFS_ID, htonl(info->id)))
+		return -1;
+
+	if (info->hs_rate &&
+	    (nla_put_be32(skb, NFTA_WGOBFS_HS_RATE, htonl(info->hs_rate)) ||
+	     nla_put_be32(skb, NFTA_WGOBFS_HS_BURST, htonl(info->hs_burst))))
+		return -1;
+
+	return 0;
+}
+
+static struct nft_expr_type nft_wgobfs_type;
+
+static const struct nft_expr_ops nft_wgobfs_ops = {
+	.type		= &nft_wgobfs_type,
+	.size		= NFT_EXPR_SIZE(sizeof(struct xt_wg_obfs_info_v1)),
+	.eval		= nft_wgobfs_eval,
+	.init		= nft_wgobfs_init,
+	.destroy	= nft_wgobfs_destroy,
+	.dump		= nft_wgobfs_dump,
+};
+
+/* no family, nft_wgobfs_init() takes ip, inet and netdev */
+static struct nft_expr_type nft_wgobfs_type __read_mostly = {
+	.name		= "wgobfs",
+	.ops		= &nft_wgobfs_ops,
+	.policy		= nft_wgobfs_policy,
+	.maxattr	= NFTA_WGOBFS_MAX,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_wgobfs_module_init(void)
+{
+	return nft_register_expr(&nft_wgobfs_type);
+}
+
+static void __exit nft_wgobfs_module_exit(void)
+{
+	nft_unregister_expr(&nft_wgobfs_type);
+}
+
+module_init(nft_wgobfs_module_init);
+module_exit(nft_wgobfs_module_exit);
+MODULE_ALIAS_NFT_EXPR("wgobfs");
+
+#endif /* >= 4.2 */
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("nftables obfuscation expression for WireGuard");
+MODULE_AUTHOR("Wei Chen <weichen302@gmail.com>");
+MODULE_VERSION("0.5");
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_OBFS_H
+#define _XT_WGOBFS_OBFS_H
+
+#include <linux/skbuff.h>
+#include <net/net_namespace.h>
+#include "xt_WGOBFS.h"
+
+/* the transform of xt_WGOBFS_main.c, exported for the nftables and tc modules */
+struct wg_obfs_ctx;
+
+/* the defaults of the options, no key */
+void wg_obfs_info_init(struct xt_wg_obfs_info_v1 *info);
+/* 0 or -EINVAL if @len is 0 or too long */
+int wg_obfs_info_set_key(struct xt_wg_obfs_info_v1 *info, const char *s,
+                         const size_t len);
+/* checks the options of @info, 0 or -EINVAL */
+int wg_obfs_info_check(const struct xt_wg_obfs_info_v1 *info);
+/* sets info->ctx and info->id, 0 or -ENOMEM */
+int wg_obfs_ctx_create(struct net *net, struct xt_wg_obfs_info_v1 *info);
+void wg_obfs_ctx_destroy(struct wg_obfs_ctx *ctx);
+
+/* checks the headers and sets the transport header of a packet whose IPv4
+ * header is @nhoff bytes from skb->data
+ */
+bool wg_obfs_skb_udp4(struct sk_buff *skb, const int nhoff);
+
+/* @skb->data is the IPv4 header and the transport header is set, returns
+ * XT_CONTINUE or NF_DROP
+ */
+unsigned int wg_obfs_target(struct sk_buff *skb, const u8 mode,
+                            const struct wg_obfs_ctx *ctx);
+
+#endif /* _XT_WGOBFS_OBFS_H */
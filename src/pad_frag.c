@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Padding as page fragments. Every CPU has a page of random bytes followed by
+ * the 256 byte values. The padding of a packet is a fragment of the random
+ * bytes, and its last byte, the masked length, a fragment of the byte values,
+ * so nothing is written or generated per packet. Every random byte goes to
+ * one packet only, the page is replaced once they are used up, and freed when
+ * the last packet that points into it is. The fragments are marked shared,
+ * so whatever writes to the packet later, ESP for one, copies them first.
+ *
+ * The receiver only reads the last byte of the padding, it cannot tell this
+ * from PRN padding.
+ */
+#include <linux/version.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include "pad_frag.h"
+
+/* SKBTX_SHARED_FRAG is from 3.8 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0)
+
+enum {
+	PAD_RANDOM_LEN = PAGE_SIZE - 256
+};
+
+struct pad_page {
+	struct page *page;
+	unsigned int off;
+};
+
+static DEFINE_PER_CPU(struct pad_page, pad_pages);
+
+static struct page *pad_page_alloc(void)
+{
+	struct page *page;
+	u8 *p;
+	int i;
+
+	page = alloc_page(GFP_ATOMIC);
+	if (!page)
+		return NULL;
+
+	p = page_address(page);
+	get_random_bytes(p, PAD_RANDOM_LEN);
+	for (i = 0; i < 256; i++)
+		p[PAD_RANDOM_LEN + i] = i;
+
+	return page;
+}
+
+/* the random bytes of the next @len bytes long padding */
+static struct page *pad_page_get(struct pad_page *pp, const int len,
+                                 unsigned int *off)
+{
+	struct page *page;
+
+	if (pp->page && pp->off + len > PAD_RANDOM_LEN) {
+		put_page(pp->page);
+		pp->page = NULL;
+	}
+
+	if (!pp->page) {
+		page = pad_page_alloc();
+		if (!page)
+			return NULL;
+
+		pp->page = page;
+		pp->off = 0;
+	}
+
+	*off = pp->off;
+	pp->off += len;
+	return pp->page;
+}
+
+/* Append @len bytes of padding that end with @last to the packet, and copy
+ * them to @pad. Return -1 if the packet has no room for two more fragments.
+ * x_tables runs targets with BH disabled, the per CPU page is safe to use.
+ */
+int wg_pad_frag(struct sk_buff *skb, u8 *pad, const int len, const u8 last)
+{
+	struct pad_page *pp;
+	struct page *page;
+	unsigned int off;
+	int nr_frags;
+
+	nr_frags = skb_shinfo(skb)->nr_frags;
+	if (skb_has_frag_list(skb) || nr_frags + 2 > MAX_SKB_FRAGS)
+		return -1;
+
+	pp = this_cpu_ptr(&pad_pages);
+	page = pad_page_get(pp, len - 1, &off);
+	if (!page)
+		return -1;
+
+	memcpy(pad, (u8 *) page_address(page) + off, len - 1);
+	pad[len - 1] = last;
+
+	get_page(page);
+	get_page(page);
+	skb_add_rx_frag(skb, nr_frags, page, off, len - 1, len - 1);
+	skb_add_rx_frag(skb, nr_frags + 1, page, PAD_RANDOM_LEN + last, 1, 1);
+
+	/* the page is in other packets, skb_has_shared_frag() stops in place
+	 * writers
+	 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,12,0)
+	skb_shinfo(skb)->flags |= SKBFL_SHARED_FRAG;
+#else
+	skb_shinfo(skb)->tx_flags |= SKBTX_SHARED_FRAG;
+#endif
+	return 0;
+}
+
+void wg_pad_frag_exit(void)
+{
+	struct pad_page *pp;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pp = per_cpu_ptr(&pad_pages, cpu);
+		if (pp->page)
+			put_page(pp->page);
+	}
+}
+
+#else
+
+int wg_pad_frag(struct sk_buff *skb, u8 *pad, const int len, const u8 last)
+{
+	return -1;
+}
+
+void wg_pad_frag_exit(void)
+{
+}
+
+#endif
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_PAD_FRAG_H
+#define _XT_WGOBFS_PAD_FRAG_H
+
+#include <linux/skbuff.h>
+
+int wg_pad_frag(struct sk_buff *skb, u8 *pad, const int len, const u8 last);
+void wg_pad_frag_exit(void);
+
+#endif /* _XT_WGOBFS_PAD_FRAG_H */
@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Alternatives to chacha for the per packet PRNs:
+ *
+ *   siphash      SipHash-2-4, 8 bytes of output per call
+ *   halfsiphash  HalfSipHash-1-3, 4 bytes per call, only 32 bit arithmetic
+ *   aes          4 AES rounds, 16 bytes per call, AES-NI on x86_64
+ *
+ * Output chunk i is the PRF of the 16 bytes input followed by i, so the state
+ * after the input is shared by all the chunks. hsiphash() of lib/siphash is
+ * not used, it is HalfSipHash on 32 bit kernels but SipHash on 64 bit ones,
+ * and both peers must compute the same bytes.
+ */
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
+#include "prf.h"
+
+static const char *const prf_names[] = {
+	[XT_WGOBFS_PRF_CHACHA] = "chacha",
+	[XT_WGOBFS_PRF_SIPHASH] = "siphash",
+	[XT_WGOBFS_PRF_HSIPHASH] = "halfsiphash",
+	[XT_WGOBFS_PRF_AES] = "aes",
+};
+
+#ifdef CONFIG_X86_64
+static bool prf_aesni __read_mostly;
+#endif
+
+/* The engine keys are chacha output of a fixed input. The key string repeats
+ * in chacha_key if it is short, it does not repeat in the engine keys.
+ */
+static void prf_derive_key(const u8 key[CHACHA20_KEY_SIZE], u8 *out,
+                           const int nblocks)
+{
+	struct chacha_state cs;
+	u8 in[CHACHA_INPUT_SIZE] = "WGOBFS prf key";
+	int i;
+
+	chacha_init_state(&cs, key, XT_WGOBFS_DEFAULT_ROUNDS);
+	for (i = 0; i < nblocks; i++) {
+		in[CHACHA_INPUT_SIZE - 1] = i;
+		chacha_hash(&cs, in, out + i * CHACHA20_BLOCK_SIZE,
+		            CHACHA20_BLOCK_WORDS);
+	}
+}
+
+void wg_prf_init(struct wg_prf *prf, const u8 id,
+                 const u8 key[CHACHA20_KEY_SIZE], const unsigned int rounds)
+{
+	u8 k[2 * CHACHA20_BLOCK_SIZE];
+
+	prf->id = id;
+	switch (id) {
+	case XT_WGOBFS_PRF_SIPHASH:
+		prf_derive_key(key, k, 1);
+		prf->sip[0] = get_unaligned_le64(k);
+		prf->sip[1] = get_unaligned_le64(k + 8);
+		break;
+	case XT_WGOBFS_PRF_HSIPHASH:
+		prf_derive_key(key, k, 1);
+		prf->hsip[0] = get_unaligned_le32(k);
+		prf->hsip[1] = get_unaligned_le32(k + 4);
+		break;
+	case XT_WGOBFS_PRF_AES:
+		prf_derive_key(key, k, 2);
+		memcpy(prf->aes, k, sizeof(prf->aes));
+		break;
+	default:
+		chacha_init_state(&prf->cs, key, rounds);
+	}
+}
+
+#define SIPROUND(v0, v1, v2, v3) ( \
+	v0 += v1, v1 = rol64(v1, 13), v1 ^= v0, v0 = rol64(v0, 32), \
+	v2 += v3, v3 = rol64(v3, 16), v3 ^= v2, \
+	v0 += v3, v3 = rol64(v3, 21), v3 ^= v0, \
+	v2 += v1, v1 = rol64(v1, 17), v1 ^= v2, v2 = rol64(v2, 32) \
+)
+
+/* chunk i is SipHash-2-4 of the input and le64(i) */
+static void prf_siphash(const u64 k[2], const u8 *in, u8 *out,
+                        const int out_words)
+{
+	u64 v0 = k[0] ^ 0x736f6d6570736575ULL;
+	u64 v1 = k[1] ^ 0x646f72616e646f6dULL;
+	u64 v2 = k[0] ^ 0x6c7967656e657261ULL;
+	u64 v3 = k[1] ^ 0x7465646279746573ULL;
+	const u64 b = (u64) (PRF_INPUT_SIZE + sizeof(u64)) << 56;
+	u64 s0, s1, s2, s3, m;
+	int i;
+
+	for (i = 0; i < PRF_INPUT_SIZE; i += sizeof(u64)) {
+		m = get_unaligned_le64(in + i);
+		v3 ^= m;
+		SIPROUND(v0, v1, v2, v3);
+		SIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	for (i = 0; i * 2 < out_words; i++) {
+		s0 = v0;
+		s1 = v1;
+		s2 = v2;
+		s3 = v3 ^ i;
+		SIPROUND(s0, s1, s2, s3);
+		SIPROUND(s0, s1, s2, s3);
+		s0 ^= i;
+
+		s3 ^= b;
+		SIPROUND(s0, s1, s2, s3);
+		SIPROUND(s0, s1, s2, s3);
+		s0 ^= b;
+		s2 ^= 0xff;
+		SIPROUND(s0, s1, s2, s3);
+		SIPROUND(s0, s1, s2, s3);
+		SIPROUND(s0, s1, s2, s3);
+		SIPROUND(s0, s1, s2, s3);
+
+		m = s0 ^ s1 ^ s2 ^ s3;
+		put_unaligned_le32(m, out + i * 8);
+		if (i * 2 + 1 < out_words)
+			put_unaligned_le32(m >> 32, out + i * 8 + 4);
+	}
+}
+
+#define HSIPROUND(v0, v1, v2, v3) ( \
+	v0 += v1, v1 = rol32(v1, 5), v1 ^= v0, v0 = rol32(v0, 16), \
+	v2 += v3, v3 = rol32(v3, 8), v3 ^= v2, \
+	v0 += v3, v3 = rol32(v3, 7), v3 ^= v0, \
+	v2 += v1, v1 = rol32(v1, 13), v1 ^= v2, v2 = rol32(v2, 16) \
+)
+
+/* word i is HalfSipHash-1-3 of the input and le32(i) */
+static void prf_hsiphash(const u32 k[2], const u8 *in, u8 *out,
+                         const int out_words)
+{
+	u32 v0 = k[0];
+	u32 v1 = k[1];
+	u32 v2 = k[0] ^ 0x6c796765U;
+	u32 v3 = k[1] ^ 0x74656462U;
+	const u32 b = (u32) (PRF_INPUT_SIZE + sizeof(u32)) << 24;
+	u32 s0, s1, s2, s3, m;
+	int i;
+
+	for (i = 0; i < PRF_INPUT_SIZE; i += sizeof(u32)) {
+		m = get_unaligned_le32(in + i);
+		v3 ^= m;
+		HSIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	for (i = 0; i < out_words; i++) {
+		s0 = v0;
+		s1 = v1;
+		s2 = v2;
+		s3 = v3 ^ i;
+		HSIPROUND(s0, s1, s2, s3);
+		s0 ^= i;
+
+		s3 ^= b;
+		HSIPROUND(s0, s1, s2, s3);
+		s0 ^= b;
+		s2 ^= 0xff;
+		HSIPROUND(s0, s1, s2, s3);
+		HSIPROUND(s0, s1, s2, s3);
+		HSIPROUND(s0, s1, s2, s3);
+
+		put_unaligned_le32(s1 ^ s3, out + i * 4);
+	}
+}
+
+static const u8 aes_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+	0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+	0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+	0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+	0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+	0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+	0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+	0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+	0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+	0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+	0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+	0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+	0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+	0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+	0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+	0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+	0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static inline u8 aes_xtime(const u8 x)
+{
+	return (x << 1) ^ ((x >> 7) * 0x1b);
+}
+
+/* Same as one AESENC instruction. The table lookups are not constant time,
+ * this is only used where AES-NI is not.
+ */
+static void aes_round(u8 *s, const u8 *rk)
+{
+	u8 t[AES_BLOCK_LEN];
+	u8 *a, x;
+	int c, r;
+
+	/* ShiftRows and SubBytes */
+	for (c = 0; c < 4; c++)
+		for (r = 0; r < 4; r++)
+			t[4 * c + r] = aes_sbox[s[4 * ((c + r) & 3) + r]];
+
+	/* MixColumns and AddRoundKey */
+	for (c = 0; c < 4; c++) {
+		a = t + 4 * c;
+		x = a[0] ^ a[1] ^ a[2] ^ a[3];
+		s[4 * c + 0] = a[0] ^ x ^ aes_xtime(a[0] ^ a[1]) ^ rk[4 * c + 0];
+		s[4 * c + 1] = a[1] ^ x ^ aes_xtime(a[1] ^ a[2]) ^ rk[4 * c + 1];
+		s[4 * c + 2] = a[2] ^ x ^ aes_xtime(a[2] ^ a[3]) ^ rk[4 * c + 2];
+		s[4 * c + 3] = a[3] ^ x ^ aes_xtime(a[3] ^ a[0]) ^ rk[4 * c + 3];
+	}
+}
+
+/* Block i is 4 AES rounds of the input, whitened by the first key and with i
+ * in its first byte. One round is not enough: each output byte would depend on
+ * 4 input bytes only, and the key would fall out of a few packets.
+ */
+static void prf_aes_generic(const u8 rk[][AES_BLOCK_LEN], const u8 *in,
+                            u8 *out, const unsigned int nblocks)
+{
+	unsigned int i, j, r;
+	u8 *s;
+
+	for (i = 0; i < nblocks; i++) {
+		s = out + i * AES_BLOCK_LEN;
+		for (j = 0; j < AES_BLOCK_LEN; j++)
+			s[j] = in[j] ^ rk[0][j];
+		s[0] ^= i;
+
+		for (r = 1; r <= AES_PRF_ROUNDS; r++)
+			aes_round(s, rk[r]);
+	}
+}
+
+static void prf_aes(const u8 rk[][AES_BLOCK_LEN], const u8 *in, u8 *out,
+                    const int out_words)
+{
+	u8 blocks[PRF_MAX_WORDS * sizeof(u32)];
+	unsigned int nblocks;
+
+	nblocks = DIV_ROUND_UP(out_words * sizeof(u32), AES_BLOCK_LEN);
+#ifdef CONFIG_X86_64
+	if (prf_aesni && prf_aes_x86(rk, in, blocks, nblocks))
+		goto out;
+#endif
+	prf_aes_generic(rk, in, blocks, nblocks);
+#ifdef CONFIG_X86_64
+out:
+#endif
+	memcpy(out, blocks, out_words * sizeof(u32));
+}
+
+void wg_prf_hash(const struct wg_prf *prf, const u8 *in, u8 *out,
+                 const int out_words)
+{
+	switch (prf->id) {
+	case XT_WGOBFS_PRF_SIPHASH:
+		prf_siphash(prf->sip, in, out, out_words);
+		break;
+	case XT_WGOBFS_PRF_HSIPHASH:
+		prf_hsiphash(prf->hsip, in, out, out_words);
+		break;
+	case XT_WGOBFS_PRF_AES:
+		prf_aes(prf->aes, in, out, out_words);
+		break;
+	default:
+		chacha_hash(&prf->cs, in, out, out_words);
+	}
+}
+
+#define PRF_BENCH_PACKETS 1024
+
+/* Hash what the v1 format hashes for a data packet, the head and 32 bytes of
+ * padding, and print the cost per packet.
+ */
+static void wg_prf_bench(void)
+{
+	struct wg_prf prf;
+	u8 key[CHACHA20_KEY_SIZE], in[PRF_INPUT_SIZE];
+	u8 out[PRF_MAX_WORDS * sizeof(u32)];
+	cycles_t c0, c1;
+	s64 t0, t1;
+	unsigned int id, i;
+
+	for (i = 0; i < CHACHA20_KEY_SIZE; i++)
+		key[i] = i;
+	memset(in, 0, sizeof(in));
+
+	for (id = 0; id < ARRAY_SIZE(prf_names); id++) {
+		wg_prf_init(&prf, id, key, XT_WGOBFS_DEFAULT_ROUNDS);
+
+		preempt_disable();
+		t0 = ktime_to_ns(ktime_get());
+		c0 = get_cycles();
+		for (i = 0; i < PRF_BENCH_PACKETS; i++) {
+			in[0] = i;
+			wg_prf_hash(&prf, in, out, 5);
+			wg_prf_hash(&prf, in, out, 8);
+		}
+		c1 = get_cycles();
+		t1 = ktime_to_ns(ktime_get());
+		preempt_enable();
+
+		/* get_cycles() is 0 where there is no cycle counter */
+		pr_info("WGOBFS: prf %-11s %5llu cycles %5llu ns per packet\n",
+		        prf_names[id],
+		        (unsigned long long) (c1 - c0) / PRF_BENCH_PACKETS,
+		        (unsigned long long) (t1 - t0) / PRF_BENCH_PACKETS);
+	}
+}
+
+void wg_prf_setup(void)
+{
+#ifdef CONFIG_X86_64
+	u8 rk[AES_PRF_ROUNDS + 1][AES_BLOCK_LEN];
+	u8 in[PRF_INPUT_SIZE];
+	u8 out[2][PRF_MAX_WORDS * sizeof(u32)];
+	const unsigned int nblocks = sizeof(out[0]) / AES_BLOCK_LEN;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(rk); i++)
+		rk[i / AES_BLOCK_LEN][i % AES_BLOCK_LEN] = i * 7;
+	for (i = 0; i < PRF_INPUT_SIZE; i++)
+		in[i] = 0xa0 + i;
+
+	/* AES-NI must give the bytes of the C code, or peers disagree */
+	if (prf_aes_x86_usable() &&
+	    prf_aes_x86((const u8 (*)[AES_BLOCK_LEN]) rk, in, out[0], nblocks)) {
+		prf_aes_generic((const u8 (*)[AES_BLOCK_LEN]) rk, in, out[1],
+		                nblocks);
+		prf_aesni = !memcmp(out[0], out[1], sizeof(out[0]));
+		if (!prf_aesni)
+			pr_warn("WGOBFS: AES-NI failed self test\n");
+	}
+#endif
+
+	wg_prf_bench();
+}
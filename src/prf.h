@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_PRF_H
+#define _XT_WGOBFS_PRF_H
+
+#include "chacha.h"
+#include "xt_WGOBFS.h"
+
+enum prf_lengths {
+	PRF_INPUT_SIZE = CHACHA_INPUT_SIZE,
+	PRF_MAX_WORDS = CHACHA20_BLOCK_WORDS,
+	AES_PRF_ROUNDS = 4,
+	AES_BLOCK_LEN = 16
+};
+
+/* Keyed PRF of a 16 bytes input, with up to 64 bytes of output. Every engine
+ * gives the same output on every architecture, so peers only need to agree on
+ * the engine.
+ */
+struct wg_prf {
+	u8 id;		/* XT_WGOBFS_PRF_* */
+	union {
+		struct chacha_state cs;
+		u64 sip[2];
+		u32 hsip[2];
+		u8 aes[AES_PRF_ROUNDS + 1][AES_BLOCK_LEN];
+	};
+};
+
+static inline bool wg_prf_valid(const unsigned int id)
+{
+	return id <= XT_WGOBFS_PRF_AES;
+}
+
+void wg_prf_init(struct wg_prf *prf, const u8 id,
+                 const u8 key[CHACHA20_KEY_SIZE], const unsigned int rounds);
+void wg_prf_hash(const struct wg_prf *prf, const u8 *in, u8 *out,
+                 const int out_words);
+/* at module load, check AES-NI and print the cost of every engine */
+void wg_prf_setup(void);
+
+/* only chacha hashes several inputs at once, 0 if it is never faster */
+static inline unsigned int wg_prf_batch_min(const struct wg_prf *prf)
+{
+	return prf->id == XT_WGOBFS_PRF_CHACHA ? chacha_batch_min() : 0;
+}
+
+static inline void wg_prf_hash_blocks(const struct wg_prf *prf, const u8 *in,
+                                      u8 *out, unsigned int nblocks)
+{
+	chacha_hash_blocks(&prf->cs, in, out, nblocks);
+}
+
+#ifdef CONFIG_X86_64
+bool prf_aes_x86_usable(void);
+bool prf_aes_x86(const u8 rk[][AES_BLOCK_LEN], const u8 *in, u8 *out,
+                 unsigned int nblocks);
+void prf_aes_blocks_aesni(const u8 rk[][AES_BLOCK_LEN], const u8 *in, u8 *out,
+                          unsigned int nblocks);
+#endif
+
+#endif /* _XT_WGOBFS_PRF_H */
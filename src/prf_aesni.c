@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * The aes PRF with AES-NI, built with -maes. Same output as prf_aes_generic().
+ */
+#include <linux/string.h>
+#include "prf.h"
+
+typedef long long aes_vec __attribute__((vector_size(AES_BLOCK_LEN)));
+
+void prf_aes_blocks_aesni(const u8 rk[][AES_BLOCK_LEN], const u8 *in, u8 *out,
+                          unsigned int nblocks)
+{
+	aes_vec k[AES_PRF_ROUNDS + 1];
+	aes_vec x[PRF_MAX_WORDS * sizeof(u32) / AES_BLOCK_LEN];
+	unsigned int i, r;
+
+	for (r = 0; r <= AES_PRF_ROUNDS; r++)
+		memcpy(&k[r], rk[r], AES_BLOCK_LEN);
+
+	memcpy(&x[0], in, AES_BLOCK_LEN);
+	x[0] ^= k[0];
+	for (i = 1; i < nblocks; i++) {
+		x[i] = x[0];
+		/* the first byte is the low byte of the first lane */
+		x[i][0] ^= i;
+	}
+
+	/* the blocks are independent, interleaved to hide the aesenc latency */
+	for (r = 1; r <= AES_PRF_ROUNDS; r++)
+		for (i = 0; i < nblocks; i++)
+			x[i] = __builtin_ia32_aesenc128(x[i], k[r]);
+
+	for (i = 0; i < nblocks; i++)
+		memcpy(out + i * AES_BLOCK_LEN, &x[i], AES_BLOCK_LEN);
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * AES-NI for the aes PRF. Built without SIMD flags, like chacha_x86.c.
+ */
+#include <linux/version.h>
+#include <asm/cpufeature.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
+#include <asm/fpu/api.h>
+#else
+#include <asm/i387.h>
+#endif
+#include "prf.h"
+
+bool prf_aes_x86_usable(void)
+{
+	return boot_cpu_has(X86_FEATURE_XMM2) && boot_cpu_has(X86_FEATURE_AES);
+}
+
+/* false if softirq interrupted a task that is using the FPU */
+bool prf_aes_x86(const u8 rk[][AES_BLOCK_LEN], const u8 *in, u8 *out,
+                 unsigned int nblocks)
+{
+	if (!irq_fpu_usable())
+		return false;
+
+	kernel_fpu_begin();
+	prf_aes_blocks_aesni(rk, in, out, nblocks);
+	kernel_fpu_end();
+	return true;
+}
@@ -0,0 +1,431 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * KUnit suite "wgobfs", built with WGOBFS_KUNIT=y in a kernel with KUnit and
+ * run when the module is loaded. Included by xt_WGOBFS_main.c for its static
+ * functions.
+ *
+ *   - chacha_hash() against the known answers of an independent chacha, for
+ *     every output length the module asks for
+ *   - xt_obfs() then xt_unobfs() on every WG message type, one case per skb
+ *     layout, linear, low tailroom, paged and cloned, each with a parameter
+ *     per PRF, wire version, padding and UDP checksum mode
+ *   - round trips per second of a few message sizes
+ */
+#include <kunit/test.h>
+
+static const u8 selftest_chacha_kat[][CHACHA20_BLOCK_SIZE] = {
+	{	/* 4 rounds */
+	0xa2, 0x5d, 0x9e, 0xcd, 0x04, 0xec, 0xf0, 0x81,
+	0x93, 0xde, 0xea, 0xe3, 0x2c, 0x89, 0xbc, 0x12,
+	0x71, 0xec, 0xd8, 0xdd, 0x54, 0x35, 0xe9, 0xed,
+	0x41, 0x6d, 0x60, 0x1d, 0x73, 0x0a, 0x24, 0xc9,
+	0x80, 0x4d, 0x19, 0x5e, 0x47, 0x49, 0x90, 0x46,
+	0x60, 0x18, 0xd6, 0x9c, 0x73, 0x04, 0x57, 0x6f,
+	0xb6, 0x40, 0x63, 0x22, 0x03, 0x5a, 0x14, 0x4e,
+	0x6e, 0x1f, 0x34, 0xa6, 0x2a, 0x5b, 0x10, 0x40
+	}, {	/* 6 rounds */
+	0x2c, 0x6a, 0xa3, 0x85, 0x63, 0xa5, 0xbf, 0x1c,
+	0xa0, 0x5c, 0xfd, 0x6f, 0x2b, 0x56, 0x73, 0x04,
+	0xc1, 0xd6, 0xea, 0x5f, 0xa3, 0x61, 0x75, 0xfc,
+	0x96, 0x05, 0x23, 0x67, 0x33, 0x37, 0x07, 0xbb,
+	0x54, 0xa9, 0x04, 0xeb, 0xe8, 0x6c, 0xd1, 0xda,
+	0x2d, 0x32, 0x11, 0x17, 0xa3, 0x41, 0x94, 0x36,
+	0x52, 0xdb, 0x9e, 0xeb, 0x52, 0x83, 0xa3, 0x2b,
+	0xe3, 0x9e, 0xb8, 0x0b, 0x06, 0x82, 0xb5, 0xa5
+	}, {	/* 8 rounds */
+	0x55, 0xa6, 0xaf, 0xd1, 0x66, 0x33, 0x56, 0x2d,
+	0x6d, 0x98, 0x62, 0x32, 0xf9, 0x53, 0xef, 0xfc,
+	0x48, 0x5e, 0x77, 0xa0, 0xdf, 0x77, 0x15, 0xf1,
+	0xfd, 0x90, 0x5a, 0x8e, 0x16, 0x06, 0x11, 0x84,
+	0x82, 0xce, 0x7b, 0x0d, 0xd6, 0x1a, 0x85, 0x8d,
+	0x63, 0xf7, 0xac, 0xb4, 0xc1, 0x6b, 0x27, 0x1e,
+	0x96, 0x0d, 0x7b, 0x00, 0xa8, 0xcc, 0xb5, 0x1d,
+	0x59, 0xa5, 0x56, 0x4f, 0x95, 0x72, 0x72, 0xe6
+	}, {	/* 12 rounds */
+	0x2d, 0x4e, 0x52, 0x45, 0x35, 0xfa, 0xb5, 0x0c,
+	0xb1, 0xed, 0x7b, 0x13, 0x03, 0x94, 0x32, 0x82,
+	0xdd, 0xf7, 0x81, 0xb2, 0x7c, 0x48, 0x3d, 0x88,
+	0x46, 0x34, 0xdc, 0x2b, 0x86, 0xa7, 0xa4, 0x0c,
+	0x6b, 0xaf, 0xdf, 0x5a, 0xf2, 0xf5, 0x48, 0x86,
+	0x56, 0xab, 0xf3, 0x8c, 0xa0, 0xfd, 0x48, 0x12,
+	0xec, 0x5e, 0x66, 0xe0, 0x09, 0x50, 0xb1, 0x25,
+	0x42, 0x9f, 0x65, 0x08, 0xa1, 0x08, 0xf1, 0x53
+	}
+};
+
+static const unsigned int selftest_chacha_rounds[] = { 4, 6, 8, 12 };
+
+/* the output lengths of the module, v2 hashes up to the longest padding */
+static const int selftest_chacha_words[] = {
+	ONE_WORD,
+	WG_COOKIE_WORDS,
+	HEAD_OBFS_WORDS,
+	MAX_RND_WORDS,
+	(V2_RND + MAX_RND_LEN) / sizeof(u32),
+	CHACHA20_BLOCK_WORDS
+};
+
+/* key 0 to 31, input 0xa0 to 0xaf, the output ends at @words */
+static void selftest_chacha(struct kunit *test)
+{
+	struct chacha_state st;
+	u8 key[CHACHA20_KEY_SIZE], in[CHACHA_INPUT_SIZE];
+	u8 out[CHACHA20_BLOCK_SIZE + sizeof(u32)];
+	unsigned int r, w, n;
+
+	for (n = 0; n < sizeof(key); n++)
+		key[n] = n;
+	for (n = 0; n < sizeof(in); n++)
+		in[n] = 0xa0 + n;
+
+	for (r = 0; r < ARRAY_SIZE(selftest_chacha_rounds); r++) {
+		chacha_init_state(&st, key, selftest_chacha_rounds[r]);
+		for (w = 0; w < ARRAY_SIZE(selftest_chacha_words); w++) {
+			n = selftest_chacha_words[w] * sizeof(u32);
+			memset(out, 0xcc, sizeof(out));
+			chacha_hash(&st, in, out, selftest_chacha_words[w]);
+			KUNIT_EXPECT_TRUE_MSG(test,
+			        !memcmp(out, selftest_chacha_kat[r], n) &&
+			        !memchr_inv(out + n, 0xcc, sizeof(out) - n),
+			        "chacha%u of %u bytes",
+			        selftest_chacha_rounds[r], n);
+		}
+	}
+}
+
+enum selftest_layout {
+	ST_LINEAR,
+	ST_LOW_TAILROOM,
+	ST_PAGED,	/* from the 8th byte of WG message in a page fragment */
+	ST_CLONED
+};
+
+#define ST_HLEN (sizeof(struct iphdr) + sizeof(struct udphdr))
+#define ST_PAGED_HEAD 8
+#define ST_MAX_LEN 1440
+
+static const struct {
+	u8 type;
+	u16 len;
+	bool mac2;	/* a handshake under load carries a cookie MAC */
+} selftest_msgs[] = {
+	{ WG_HANDSHAKE_INIT, 148, false },
+	{ WG_HANDSHAKE_INIT, 148, true },
+	{ WG_HANDSHAKE_RESP, 92, false },
+	{ WG_HANDSHAKE_RESP, 92, true },
+	{ WG_COOKIE, 64, false },
+	{ WG_DATA, 32, false },
+	{ WG_DATA, 48, false },
+	{ WG_DATA, 128, false },
+	{ WG_DATA, 1024, false },
+	{ WG_DATA, ST_MAX_LEN, false }
+};
+
+static void selftest_msg_fill(u8 *msg, const int i)
+{
+	const int len = selftest_msgs[i].len;
+
+	get_random_bytes(msg, len);
+	msg[0] = selftest_msgs[i].type;
+	msg[1] = msg[2] = msg[3] = 0;
+	if (!selftest_msgs[i].mac2 && selftest_msgs[i].type != WG_COOKIE &&
+	    selftest_msgs[i].type != WG_DATA)
+		memset(msg + len - WG_COOKIE_LEN, 0, WG_COOKIE_LEN);
+}
+
+/* an IPv4 UDP packet of @msg with valid checksums */
+static struct sk_buff *selftest_skb(const u8 *msg, const int len,
+                                    const enum selftest_layout layout)
+{
+	const int head = layout == ST_PAGED ? ST_PAGED_HEAD : len;
+	const int tailroom = layout == ST_LOW_TAILROOM ? 0 : MAX_RND_LEN;
+	struct sk_buff *skb;
+	struct iphdr *iph;
+	struct udphdr *udph;
+	struct page *page;
+
+	skb = alloc_skb(LL_MAX_HEADER + ST_HLEN + head + tailroom, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	/* the slack of the allocation goes to the headroom, for an exact
+	 * tailroom
+	 */
+	skb_reserve(skb, skb_tailroom(skb) - ST_HLEN - head - tailroom);
+	skb_reset_network_header(skb);
+	iph = (struct iphdr *) skb_put(skb, sizeof(*iph));
+	memset(iph, 0, sizeof(*iph));
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) / 4;
+	iph->tos = 0x88;
+	iph->tot_len = htons(ST_HLEN + len);
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = htonl(0xc0000201);
+	iph->daddr = htonl(0xc0000202);
+
+	skb_set_transport_header(skb, sizeof(*iph));
+	udph = (struct udphdr *) skb_put(skb, sizeof(*udph));
+	udph->source = htons(51820);
+	udph->dest = htons(6789);
+	udph->len = htons(sizeof(*udph) + len);
+	memcpy(skb_put(skb, head), msg, head);
+
+	if (head < len) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+
+		memcpy(page_address(page), msg + head, len - head);
+		skb_add_rx_frag(skb, 0, page, 0, len - head, PAGE_SIZE);
+	}
+
+	iph = ip_hdr(skb);
+	udp_csum_full(skb, iph, udp_hdr(skb));
+	ip_send_check(iph);
+	skb->protocol = htons(ETH_P_IP);
+	return skb;
+}
+
+static bool selftest_csum_ok(struct sk_buff *skb, const bool zero_ok)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	const struct udphdr *udph = udp_hdr(skb);
+
+	if (ip_fast_csum((const u8 *) iph, iph->ihl) ||
+	    ntohs(iph->tot_len) != skb->len)
+		return false;
+
+	if (!udph->check)
+		return zero_ok;
+
+	return !csum_tcpudp_magic(iph->saddr, iph->daddr, ntohs(udph->len),
+	                          IPPROTO_UDP,
+	                          skb_checksum(skb, skb_transport_offset(skb),
+	                                       ntohs(udph->len), 0));
+}
+
+static bool selftest_msg_ok(const struct sk_buff *skb, const u8 *msg,
+                            const int len)
+{
+	u8 buf[64];
+	int off, n;
+
+	if (skb->len != ST_HLEN + len ||
+	    ntohs(udp_hdr(skb)->len) != sizeof(struct udphdr) + len)
+		return false;
+
+	for (off = 0; off < len; off += n) {
+		n = min_t(int, len - off, sizeof(buf));
+		if (skb_copy_bits(skb, ST_HLEN + off, buf, n) ||
+		    memcmp(buf, msg + off, n))
+			return false;
+	}
+
+	return true;
+}
+
+static bool selftest_round_trip(const struct wg_obfs_ctx *ctx,
+                                const u8 *msg, const int len,
+                                const enum selftest_layout layout)
+{
+	const bool zero_ok = ctx->udp_csum == XT_WGOBFS_UDP_CSUM_NONE;
+	struct sk_buff *skb, *orig = NULL;
+	unsigned int ret;
+	bool ok = false;
+
+	skb = selftest_skb(msg, len, layout);
+	if (!skb)
+		return false;
+
+	if (layout == ST_CLONED) {
+		orig = skb;
+		skb = skb_clone(orig, GFP_KERNEL);
+		if (!skb)
+			goto out;
+	}
+
+	/* targets run with BH disabled */
+	local_bh_disable();
+	ret = xt_obfs(skb, ctx);
+	local_bh_enable();
+	if (ret == NF_DROP) {
+		/* only keepalives are dropped on purpose */
+		ok = msg[0] == WG_DATA && len == WG_MIN_LEN;
+		goto out;
+	}
+
+	if (ret != XT_CONTINUE || !selftest_csum_ok(skb, zero_ok))
+		goto out;
+
+	local_bh_disable();
+	ret = xt_unobfs(skb, ctx);
+	local_bh_enable();
+	ok = ret == XT_CONTINUE && selftest_msg_ok(skb, msg, len) &&
+	     selftest_csum_ok(skb, zero_ok);
+
+	/* the data a clone shares must be left alone */
+	if (orig)
+		ok = ok && selftest_msg_ok(orig, msg, len) &&
+		     selftest_csum_ok(orig, false);
+out:
+	kfree_skb(skb);
+	kfree_skb(orig);
+	return ok;
+}
+
+struct selftest_opts {
+	u8 prf;
+	u8 wire_ver;
+	u8 padding;
+	u8 udp_csum;
+};
+
+#define ST_CSUM(prf, wire_ver, padding) \
+	{ prf, wire_ver, padding, XT_WGOBFS_UDP_CSUM_KEEP }, \
+	{ prf, wire_ver, padding, XT_WGOBFS_UDP_CSUM_NONE }, \
+	{ prf, wire_ver, padding, XT_WGOBFS_UDP_CSUM_SW }
+#define ST_PADDING(prf, wire_ver) \
+	ST_CSUM(prf, wire_ver, XT_WGOBFS_PADDING_COPY), \
+	ST_CSUM(prf, wire_ver, XT_WGOBFS_PADDING_FRAG)
+#define ST_WIRE(prf) \
+	ST_PADDING(prf, XT_WGOBFS_WIRE_V1), ST_PADDING(prf, XT_WGOBFS_WIRE_V2)
+
+/* every PRF, wire version, padding and UDP checksum mode */
+static const struct selftest_opts selftest_opts[] = {
+	ST_WIRE(XT_WGOBFS_PRF_CHACHA),
+	ST_WIRE(XT_WGOBFS_PRF_SIPHASH),
+	ST_WIRE(XT_WGOBFS_PRF_HSIPHASH),
+	ST_WIRE(XT_WGOBFS_PRF_AES)
+};
+
+static void selftest_opts_desc(const struct selftest_opts *o, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE,
+	         "prf %u wire v%u padding %u udp csum %u",
+	         o->prf, o->wire_ver, o->padding, o->udp_csum);
+}
+
+KUNIT_ARRAY_PARAM(selftest_opts, selftest_opts, selftest_opts_desc);
+
+static void selftest_key(u8 key[XT_CHACHA_KEY_SIZE])
+{
+	int i;
+
+	for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+		key[i] = "mysecretkey"[i % 11];
+}
+
+/* every WG message type through a packet of @layout */
+static void selftest_obfs(struct kunit *test,
+                          const enum selftest_layout layout)
+{
+	const struct selftest_opts *o = test->param_value;
+	struct wg_obfs_ctx ctx = {
+		.wire_ver = o->wire_ver,
+		.padding = o->padding,
+		.udp_csum = o->udp_csum,
+	};
+	u8 key[XT_CHACHA_KEY_SIZE];
+	u8 *msg;
+	int i;
+
+	msg = kunit_kmalloc(test, ST_MAX_LEN, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, msg);
+
+	selftest_key(key);
+	wg_prf_init(&ctx.prf, o->prf, key, XT_WGOBFS_DEFAULT_ROUNDS);
+	for (i = 0; i < ARRAY_SIZE(selftest_msgs); i++) {
+		selftest_msg_fill(msg, i);
+		KUNIT_EXPECT_TRUE_MSG(test,
+		        selftest_round_trip(&ctx, msg, selftest_msgs[i].len,
+		                            layout),
+		        "type %u len %u", selftest_msgs[i].type,
+		        selftest_msgs[i].len);
+	}
+}
+
+static void selftest_linear(struct kunit *test)
+{
+	selftest_obfs(test, ST_LINEAR);
+}
+
+static void selftest_low_tailroom(struct kunit *test)
+{
+	selftest_obfs(test, ST_LOW_TAILROOM);
+}
+
+static void selftest_paged(struct kunit *test)
+{
+	selftest_obfs(test, ST_PAGED);
+}
+
+static void selftest_cloned(struct kunit *test)
+{
+	selftest_obfs(test, ST_CLONED);
+}
+
+enum { ST_SPEED_PKTS = 1 << 14 };
+
+/* the same skb goes back and forth, so the padding always fits */
+static void selftest_speed(struct kunit *test)
+{
+	static const int msgs[] = { 0, 7, 8, 9 };
+	struct wg_obfs_ctx ctx = {
+		.wire_ver = XT_WGOBFS_WIRE_V1,
+		.udp_csum = XT_WGOBFS_UDP_CSUM_KEEP,
+		.padding = XT_WGOBFS_PADDING_COPY,
+	};
+	u8 key[XT_CHACHA_KEY_SIZE];
+	struct sk_buff *skb;
+	ktime_t t0;
+	u8 *msg;
+	u64 ns;
+	int i, n;
+
+	msg = kunit_kmalloc(test, ST_MAX_LEN, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, msg);
+
+	selftest_key(key);
+	wg_prf_init(&ctx.prf, XT_WGOBFS_PRF_CHACHA, key,
+	            XT_WGOBFS_DEFAULT_ROUNDS);
+	for (i = 0; i < ARRAY_SIZE(msgs); i++) {
+		selftest_msg_fill(msg, msgs[i]);
+		skb = selftest_skb(msg, selftest_msgs[msgs[i]].len, ST_LINEAR);
+		KUNIT_ASSERT_NOT_NULL(test, skb);
+
+		local_bh_disable();
+		t0 = ktime_get();
+		for (n = 0; n < ST_SPEED_PKTS; n++) {
+			if (xt_obfs(skb, &ctx) != XT_CONTINUE ||
+			    xt_unobfs(skb, &ctx) != XT_CONTINUE)
+				break;
+		}
+		ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+		local_bh_enable();
+		kfree_skb(skb);
+
+		kunit_info(test, "type %u len %4u %llu round trips/s\n",
+		           selftest_msgs[msgs[i]].type, selftest_msgs[msgs[i]].len,
+		           div64_u64((u64) n * NSEC_PER_SEC, ns ? : 1));
+	}
+}
+
+static struct kunit_case wg_obfs_test_cases[] = {
+	KUNIT_CASE(selftest_chacha),
+	KUNIT_CASE_PARAM(selftest_linear, selftest_opts_gen_params),
+	KUNIT_CASE_PARAM(selftest_low_tailroom, selftest_opts_gen_params),
+	KUNIT_CASE_PARAM(selftest_paged, selftest_opts_gen_params),
+	KUNIT_CASE_PARAM(selftest_cloned, selftest_opts_gen_params),
+	KUNIT_CASE(selftest_speed),
+	{ }
+};
+
+static struct kunit_suite wg_obfs_test_suite = {
+	.name = "wgobfs",
+	.test_cases = wg_obfs_test_cases,
+};
+
+kunit_test_suite(wg_obfs_test_suite);
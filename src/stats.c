@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Per rule counters. Each rule has a set per CPU, summed when they are read
+ * from /proc/net/xt_wgobfs or the WGOBFS generic netlink family. The rules
+ * are listed by their id, which the kernel also writes into the rule.
+ *
+ * A rule is checked again, with new counters, whenever its table is replaced.
+ */
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <net/genetlink.h>
+#include "stats.h"
+
+static const char *const wg_obfs_stat_names[XT_WGOBFS_STAT_MAX] = {
+	[XT_WGOBFS_STAT_OBFS_PKTS] = "obfs_pkts",
+	[XT_WGOBFS_STAT_OBFS_BYTES] = "obfs_bytes",
+	[XT_WGOBFS_STAT_UNOBFS_PKTS] = "unobfs_pkts",
+	[XT_WGOBFS_STAT_UNOBFS_BYTES] = "unobfs_bytes",
+	[XT_WGOBFS_STAT_KEEPALIVE_DROP] = "keepalive_drop",
+	[XT_WGOBFS_STAT_PAD_BYTES] = "pad_bytes",
+	[XT_WGOBFS_STAT_EXPAND] = "expand",
+	[XT_WGOBFS_STAT_DROP_UNSHARE] = "drop_unshare",
+	[XT_WGOBFS_STAT_DROP_SHORT] = "drop_short",
+	[XT_WGOBFS_STAT_DROP_BAD_PAD] = "drop_bad_pad",
+	[XT_WGOBFS_STAT_DROP_INVALID] = "drop_invalid",
+	[XT_WGOBFS_STAT_DROP_HS_LIMIT] = "drop_hs_limit",
+};
+
+/* the rules of every namespace, changed from checkentry and destroy */
+static LIST_HEAD(stats_list);
+static DEFINE_MUTEX(stats_lock);
+static u32 stats_next_id;
+
+struct wg_obfs_rule_stats *wg_obfs_stats_create(struct net *net, const u8 mode)
+{
+	struct wg_obfs_rule_stats *rs;
+	int cpu;
+
+	rs = kmalloc(sizeof(*rs), GFP_KERNEL);
+	if (!rs)
+		return NULL;
+
+	rs->pcpu = alloc_percpu(struct wg_obfs_stats);
+	if (!rs->pcpu) {
+		kfree(rs);
+		return NULL;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(rs->pcpu, cpu)->syncp);
+#endif
+
+	rs->net = net;
+	rs->mode = mode;
+
+	mutex_lock(&stats_lock);
+	/* 0 is a rule without counters */
+	if (++stats_next_id == 0)
+		++stats_next_id;
+	rs->id = stats_next_id;
+	list_add_tail(&rs->list, &stats_list);
+	mutex_unlock(&stats_lock);
+	return rs;
+}
+
+void wg_obfs_stats_destroy(struct wg_obfs_rule_stats *rs)
+{
+	if (!rs)
+		return;
+
+	mutex_lock(&stats_lock);
+	list_del(&rs->list);
+	mutex_unlock(&stats_lock);
+
+	free_percpu(rs->pcpu);
+	kfree(rs);
+}
+
+static void wg_obfs_stats_read(const struct wg_obfs_rule_stats *rs,
+                               u64 cnt[XT_WGOBFS_STAT_MAX])
+{
+	const struct wg_obfs_stats *st;
+	u64 tmp[XT_WGOBFS_STAT_MAX];
+	unsigned int start;
+	int cpu, i;
+
+	memset(cnt, 0, sizeof(tmp));
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(rs->pcpu, cpu);
+		do {
+			start = u64_stats_fetch_begin(&st->syncp);
+			memcpy(tmp, st->cnt, sizeof(tmp));
+		} while (u64_stats_fetch_retry(&st->syncp, start));
+
+		for (i = 0; i < XT_WGOBFS_STAT_MAX; i++)
+			cnt[i] += tmp[i];
+	}
+}
+
+static int wg_obfs_stats_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq_file_net(seq);
+	struct wg_obfs_rule_stats *rs;
+	u64 cnt[XT_WGOBFS_STAT_MAX];
+	int i;
+
+	seq_puts(seq, "id mode");
+	for (i = 0; i < XT_WGOBFS_STAT_MAX; i++)
+		seq_printf(seq, " %s", wg_obfs_stat_names[i]);
+	seq_putc(seq, '\n');
+
+	mutex_lock(&stats_lock);
+	list_for_each_entry(rs, &stats_list, list) {
+		if (!net_eq(rs->net, net))
+			continue;
+
+		wg_obfs_stats_read(rs, cnt);
+		seq_printf(seq, "%u %s", rs->id,
+		           rs->mode == XT_MODE_OBFS ? "obfs" : "unobfs");
+		for (i = 0; i < XT_WGOBFS_STAT_MAX; i++)
+			seq_printf(seq, " %llu", (unsigned long long) cnt[i]);
+		seq_putc(seq, '\n');
+	}
+	mutex_unlock(&stats_lock);
+	return 0;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,18,0)
+static int wg_obfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, wg_obfs_stats_show);
+}
+
+static const struct file_operations wg_obfs_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = wg_obfs_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release_net,
+};
+#endif
+
+static int __net_init wg_obfs_stats_net_init(struct net *net)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,18,0)
+	if (!proc_create_net_single("xt_wgobfs", 0444, net->proc_net,
+	                            wg_obfs_stats_show, NULL))
+		return -ENOMEM;
+#else
+	if (!proc_create("xt_wgobfs", 0444, net->proc_net,
+	                 &wg_obfs_stats_fops))
+		return -ENOMEM;
+#endif
+	return 0;
+}
+
+static void __net_exit wg_obfs_stats_net_exit(struct net *net)
+{
+	remove_proc_entry("xt_wgobfs", net->proc_net);
+}
+
+static struct pernet_operations wg_obfs_stats_net_ops = {
+	.init = wg_obfs_stats_net_init,
+	.exit = wg_obfs_stats_net_exit,
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+static struct genl_family wg_obfs_genl;
+
+static int wg_obfs_stats_fill(struct sk_buff *skb,
+                              const struct netlink_callback *cb,
+                              const struct wg_obfs_rule_stats *rs)
+{
+	u64 cnt[XT_WGOBFS_STAT_MAX];
+	struct nlattr *nest;
+	void *hdr;
+	int i;
+
+	hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+	                  &wg_obfs_genl, NLM_F_MULTI, XT_WGOBFS_CMD_GET_STATS);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(skb, XT_WGOBFS_A_RULE_ID, rs->id) ||
+	    nla_put_u8(skb, XT_WGOBFS_A_MODE, rs->mode))
+		goto cancel;
+
+	nest = nla_nest_start(skb, XT_WGOBFS_A_STATS);
+	if (!nest)
+		goto cancel;
+
+	wg_obfs_stats_read(rs, cnt);
+	for (i = 0; i < XT_WGOBFS_STAT_MAX; i++) {
+		if (nla_put_u64_64bit(skb, i + 1, cnt[i], XT_WGOBFS_STAT_A_PAD))
+			goto cancel;
+	}
+
+	nla_nest_end(skb, nest);
+	genlmsg_end(skb, hdr);
+	return 0;
+
+cancel:
+	genlmsg_cancel(skb, hdr);
+	return -EMSGSIZE;
+}
+
+/* cb->args[0] is the number of rules of the namespace already sent */
+static int wg_obfs_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct net *net = sock_net(skb->sk);
+	struct wg_obfs_rule_stats *rs;
+	long i = 0;
+
+	mutex_lock(&stats_lock);
+	list_for_each_entry(rs, &stats_list, list) {
+		if (!net_eq(rs->net, net))
+			continue;
+
+		if (i >= cb->args[0] && wg_obfs_stats_fill(skb, cb, rs))
+			break;
+		i++;
+	}
+	mutex_unlock(&stats_lock);
+
+	cb->args[0] = i;
+	return skb->len;
+}
+
+static const struct genl_ops wg_obfs_genl_ops[] = {
+	{
+		.cmd = XT_WGOBFS_CMD_GET_STATS,
+		.dumpit = wg_obfs_stats_dump,
+	},
+};
+
+/* no request attributes, nothing to parse */
+static struct genl_family wg_obfs_genl = {
+	.name = XT_WGOBFS_GENL_NAME,
+	.version = XT_WGOBFS_GENL_VERSION,
+	.netnsok = true,
+	.module = THIS_MODULE,
+	.ops = wg_obfs_genl_ops,
+	.n_ops = ARRAY_SIZE(wg_obfs_genl_ops),
+};
+#endif
+
+int wg_obfs_stats_init(void)
+{
+	int ret;
+
+	ret = register_pernet_subsys(&wg_obfs_stats_net_ops);
+	if (ret)
+		return ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+	ret = genl_register_family(&wg_obfs_genl);
+	if (ret)
+		unregister_pernet_subsys(&wg_obfs_stats_net_ops);
+#endif
+	return ret;
+}
+
+void wg_obfs_stats_exit(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)
+	genl_unregister_family(&wg_obfs_genl);
+#endif
+	unregister_pernet_subsys(&wg_obfs_stats_net_ops);
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#ifndef _XT_WGOBFS_STATS_H
+#define _XT_WGOBFS_STATS_H
+
+#include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <net/net_namespace.h>
+#include "xt_WGOBFS.h"
+
+struct wg_obfs_stats {
+	struct u64_stats_sync syncp;
+	u64 cnt[XT_WGOBFS_STAT_MAX];
+} ____cacheline_aligned;
+
+/* counters of a revision 1 rule */
+struct wg_obfs_rule_stats {
+	struct wg_obfs_stats __percpu *pcpu;
+	struct list_head list;
+	struct net *net;
+	u32 id;
+	u8 mode;
+};
+
+struct wg_obfs_rule_stats *wg_obfs_stats_create(struct net *net, const u8 mode);
+void wg_obfs_stats_destroy(struct wg_obfs_rule_stats *rs);
+int wg_obfs_stats_init(void);
+void wg_obfs_stats_exit(void);
+
+/* targets run with BH disabled */
+static inline void wg_obfs_stats_add(struct wg_obfs_rule_stats *rs,
+                                     const enum xt_wgobfs_stat s, const u64 n)
+{
+	struct wg_obfs_stats *st;
+
+	if (!rs)
+		return;
+
+	st = this_cpu_ptr(rs->pcpu);
+	u64_stats_update_begin(&st->syncp);
+	st->cnt[s] += n;
+	u64_stats_update_end(&st->syncp);
+}
+
+#endif /* _XT_WGOBFS_STATS_H */
@@ -0,0 +1,38 @@
+#ifndef _TC_WGOBFS_H
+#define _TC_WGOBFS_H
+
+#include <linux/pkt_cls.h>
+#include "xt_WGOBFS.h"
+
+/* the tc action "wgobfs". Out of tree actions have no TCA_ID_*, the kernel
+ * only needs the id to be unique, tc finds the action by its kind.
+ */
+#define TCA_ID_WGOBFS 250
+
+struct tc_wgobfs {
+    tc_gen;
+};
+
+/* the options of revision 1 of the WGOBFS target, u32 in host byte order as
+ * the other tc actions
+ */
+enum {
+    TCA_WGOBFS_UNSPEC,
+    TCA_WGOBFS_TM,
+    TCA_WGOBFS_PARMS,               /* struct tc_wgobfs */
+    TCA_WGOBFS_PAD,
+    TCA_WGOBFS_KEY,                 /* string, as --key */
+    TCA_WGOBFS_MODE,                /* XT_MODE_* */
+    TCA_WGOBFS_WIRE_VER,
+    TCA_WGOBFS_ROUNDS,
+    TCA_WGOBFS_PRF,
+    TCA_WGOBFS_UDP_CSUM,
+    TCA_WGOBFS_PADDING,
+    TCA_WGOBFS_HS_RATE,
+    TCA_WGOBFS_HS_BURST,
+    TCA_WGOBFS_ID,                  /* dumped, the rule in /proc/net/xt_wgobfs */
+    __TCA_WGOBFS_MAX
+};
+#define TCA_WGOBFS_MAX (__TCA_WGOBFS_MAX - 1)
+
+#endif
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wgobfs
+
+#if !defined(_XT_WGOBFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _XT_WGOBFS_TRACE_H
+
+#include <linux/tracepoint.h>
+#include "xt_WGOBFS.h"
+
+/*
+ * Tracepoints of the packet path. A tracepoint is a static key, it is a
+ * no-op until it is enabled, e.g.
+ *
+ *   perf record -e 'wgobfs:*' -a
+ *   bpftrace -e 'tracepoint:wgobfs:wgobfs_prn_insert { @[args->iters] = count(); }'
+ */
+
+/* so perf and bpftrace can print the names, 4.2 or later */
+#ifndef TRACE_DEFINE_ENUM
+#define TRACE_DEFINE_ENUM(a)
+#endif
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_KEEPALIVE_DROP);
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_DROP_UNSHARE);
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_DROP_SHORT);
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_DROP_BAD_PAD);
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_DROP_INVALID);
+TRACE_DEFINE_ENUM(XT_WGOBFS_STAT_DROP_HS_LIMIT);
+
+#define wgobfs_show_drop(why)                                           \
+        __print_symbolic(why,                                           \
+                { XT_WGOBFS_STAT_KEEPALIVE_DROP, "keepalive" },         \
+                { XT_WGOBFS_STAT_DROP_UNSHARE, "unshare" },             \
+                { XT_WGOBFS_STAT_DROP_SHORT, "short" },                 \
+                { XT_WGOBFS_STAT_DROP_BAD_PAD, "bad_pad" },             \
+                { XT_WGOBFS_STAT_DROP_INVALID, "invalid" },             \
+                { XT_WGOBFS_STAT_DROP_HS_LIMIT, "hs_limit" })
+
+/* a WG message obfuscated, @type before the mac2 mark */
+TRACE_EVENT(wgobfs_obfs,
+        TP_PROTO(u8 type, int len, int rnd_len, u8 wire_ver),
+        TP_ARGS(type, len, rnd_len, wire_ver),
+        TP_STRUCT__entry(
+                __field(u8, type)
+                __field(u8, wire_ver)
+                __field(int, len)
+                __field(int, rnd_len)
+        ),
+        TP_fast_assign(
+                __entry->type = type;
+                __entry->wire_ver = wire_ver;
+                __entry->len = len;
+                __entry->rnd_len = rnd_len;
+        ),
+        TP_printk("type=0x%02x len=%d pad=%d wire=v%u", __entry->type,
+                  __entry->len, __entry->rnd_len, __entry->wire_ver)
+);
+
+/* a WG message restored, @type as decoded, 0x11 and 0x12 had their mac2 */
+TRACE_EVENT(wgobfs_unobfs,
+        TP_PROTO(u8 type, int len, int rnd_len),
+        TP_ARGS(type, len, rnd_len),
+        TP_STRUCT__entry(
+                __field(u8, type)
+                __field(int, len)
+                __field(int, rnd_len)
+        ),
+        TP_fast_assign(
+                __entry->type = type;
+                __entry->len = len;
+                __entry->rnd_len = rnd_len;
+        ),
+        TP_printk("type=0x%02x len=%d pad=%d", __entry->type, __entry->len,
+                  __entry->rnd_len)
+);
+
+/* wire v1 padding length, @iters hashes of the rejection loop */
+TRACE_EVENT(wgobfs_prn_insert,
+        TP_PROTO(int rnd_len, int iters),
+        TP_ARGS(rnd_len, iters),
+        TP_STRUCT__entry(
+                __field(int, rnd_len)
+                __field(int, iters)
+        ),
+        TP_fast_assign(
+                __entry->rnd_len = rnd_len;
+                __entry->iters = iters;
+        ),
+        TP_printk("pad=%d iters=%d", __entry->rnd_len, __entry->iters)
+);
+
+/* the head is reallocated to append the padding */
+TRACE_EVENT(wgobfs_expand,
+        TP_PROTO(unsigned int len, int tailroom, bool cloned, bool paged),
+        TP_ARGS(len, tailroom, cloned, paged),
+        TP_STRUCT__entry(
+                __field(unsigned int, len)
+                __field(int, tailroom)
+                __field(bool, cloned)
+                __field(bool, paged)
+        ),
+        TP_fast_assign(
+                __entry->len = len;
+                __entry->tailroom = tailroom;
+                __entry->cloned = cloned;
+                __entry->paged = paged;
+        ),
+        TP_printk("len=%u tailroom=%d cloned=%d paged=%d", __entry->len,
+                  __entry->tailroom, __entry->cloned, __entry->paged)
+);
+
+TRACE_EVENT(wgobfs_drop,
+        TP_PROTO(u8 mode, unsigned int len, int why),
+        TP_ARGS(mode, len, why),
+        TP_STRUCT__entry(
+                __field(u8, mode)
+                __field(unsigned int, len)
+                __field(int, why)
+        ),
+        TP_fast_assign(
+                __entry->mode = mode;
+                __entry->len = len;
+                __entry->why = why;
+        ),
+        TP_printk("%s len=%u reason=%s",
+                  __entry->mode == XT_MODE_OBFS ? "obfs" : "unobfs",
+                  __entry->len, wgobfs_show_drop(__entry->why))
+);
+
+#endif /* _XT_WGOBFS_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
@@ -5,11 +5,105 @@
 #define XT_CHACHA_KEY_SIZE 32
 #define XT_MODE_OBFS   0
 #define XT_MODE_UNOBFS 1
+#define XT_WGOBFS_WIRE_V1 1
+#define XT_WGOBFS_WIRE_V2 2
+#define XT_WGOBFS_DEFAULT_ROUNDS 6
+#define XT_WGOBFS_PRF_CHACHA   0
+#define XT_WGOBFS_PRF_SIPHASH  1
+#define XT_WGOBFS_PRF_HSIPHASH 2
+#define XT_WGOBFS_PRF_AES      3
+#define XT_WGOBFS_UDP_CSUM_KEEP 0
+#define XT_WGOBFS_UDP_CSUM_NONE 1
+#define XT_WGOBFS_UDP_CSUM_SW   2
+#define XT_WGOBFS_PADDING_COPY 0
+#define XT_WGOBFS_PADDING_FRAG 1
+#define XT_WGOBFS_HS_MAX   100000
+#define XT_WGOBFS_HS_BURST 5
 
+/* per rule counters, in /proc/net/xt_wgobfs and the netlink dump */
+enum xt_wgobfs_stat {
+    XT_WGOBFS_STAT_OBFS_PKTS,
+    XT_WGOBFS_STAT_OBFS_BYTES,
+    XT_WGOBFS_STAT_UNOBFS_PKTS,
+    XT_WGOBFS_STAT_UNOBFS_BYTES,
+    XT_WGOBFS_STAT_KEEPALIVE_DROP,  /* keepalives dropped on purpose */
+    XT_WGOBFS_STAT_PAD_BYTES,
+    XT_WGOBFS_STAT_EXPAND,          /* heads reallocated for the padding */
+    XT_WGOBFS_STAT_DROP_UNSHARE,    /* no memory to write or extend */
+    XT_WGOBFS_STAT_DROP_SHORT,
+    XT_WGOBFS_STAT_DROP_BAD_PAD,    /* padding length out of range */
+    XT_WGOBFS_STAT_DROP_INVALID,    /* does not decode into a WG message */
+    XT_WGOBFS_STAT_DROP_HS_LIMIT,
+    XT_WGOBFS_STAT_MAX
+};
+
+/* generic netlink family, XT_WGOBFS_CMD_GET_STATS dumps one message per rule
+ * of the network namespace
+ */
+#define XT_WGOBFS_GENL_NAME    "WGOBFS"
+#define XT_WGOBFS_GENL_VERSION 1
+
+enum {
+    XT_WGOBFS_CMD_UNSPEC,
+    XT_WGOBFS_CMD_GET_STATS
+};
+
+enum {
+    XT_WGOBFS_A_UNSPEC,
+    XT_WGOBFS_A_RULE_ID,            /* u32 */
+    XT_WGOBFS_A_MODE,               /* u8, XT_MODE_* */
+    XT_WGOBFS_A_STATS,              /* nested, a u64 per counter */
+    __XT_WGOBFS_A_MAX
+};
+#define XT_WGOBFS_A_MAX (__XT_WGOBFS_A_MAX - 1)
+
+/* in XT_WGOBFS_A_STATS, counter i is attribute i + 1 */
+#define XT_WGOBFS_STAT_A_PAD (XT_WGOBFS_STAT_MAX + 1)
+
+/* attributes of the nftables expression "wgobfs", the options of revision 1,
+ * u32 in network byte order
+ */
+enum nft_wgobfs_attributes {
+    NFTA_WGOBFS_UNSPEC,
+    NFTA_WGOBFS_KEY,                /* string, as --key */
+    NFTA_WGOBFS_MODE,               /* XT_MODE_* */
+    NFTA_WGOBFS_WIRE_VER,
+    NFTA_WGOBFS_ROUNDS,
+    NFTA_WGOBFS_PRF,
+    NFTA_WGOBFS_UDP_CSUM,
+    NFTA_WGOBFS_PADDING,
+    NFTA_WGOBFS_HS_RATE,
+    NFTA_WGOBFS_HS_BURST,
+    NFTA_WGOBFS_ID,                 /* dumped, the rule in /proc/net/xt_wgobfs */
+    __NFTA_WGOBFS_MAX
+};
+#define NFTA_WGOBFS_MAX (__NFTA_WGOBFS_MAX - 1)
+
+/* revision 0 */
 struct xt_wg_obfs_info {
     unsigned char mode;
     char key[XT_WGOBFS_MAX_KEY_SIZE + 1];
     unsigned char chacha_key[XT_CHACHA_KEY_SIZE];  /* 256 bits chacha key */
 };
 
+/* revision 1 */
+struct xt_wg_obfs_info_v1 {
+    unsigned char mode;
+    char key[XT_WGOBFS_MAX_KEY_SIZE + 1];
+    unsigned char chacha_key[XT_CHACHA_KEY_SIZE];  /* 256 bits chacha key */
+    unsigned char wire_ver;  /* XT_WGOBFS_WIRE_V1 or XT_WGOBFS_WIRE_V2 */
+    unsigned char rounds;    /* chacha rounds, 4, 6, 8 or 12 */
+    unsigned char prf;       /* XT_WGOBFS_PRF_* */
+    unsigned char udp_csum;  /* XT_WGOBFS_UDP_CSUM_*, of --obfs */
+    unsigned char padding;   /* XT_WGOBFS_PADDING_*, of --obfs */
+    unsigned int hs_rate;    /* handshakes per second per source, of --unobfs */
+    unsigned int hs_burst;
+
+    /* set by the kernel, the rule in /proc/net/xt_wgobfs */
+    unsigned int id;
+
+    /* used internally by the kernel */
+    struct wg_obfs_ctx *ctx __attribute__((aligned(8)));
+};
+
 #endif
@@ -4,11 +4,21 @@
 
 #include <linux/version.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include <linux/netfilter_ipv4/ip_tables.h>
 #include <net/ip.h>
+#include <net/dsfield.h>
 #include "xt_WGOBFS.h"
 #include "wg.h"
-#include "chacha.h"
+#include "prf.h"
+#include "pad_frag.h"
+#include "hs_limit.h"
+#include "stats.h"
+#include "latency.h"
+#include "obfs.h"
+
+#define CREATE_TRACE_POINTS
+#include "trace.h"
 
 #define WG_HANDSHAKE_INIT       0x01
 #define WG_HANDSHAKE_RESP       0x02
@@ -27,24 +37,127 @@ enum chacha_output_lengths {
 	HEAD_OBFS_WORDS = 16 / sizeof(u32) + 1
 };
 
+/* Wire format v2 derives every per-packet PRN from one chacha block of the
+ * unchanged 16th to 31st bytes of WG message. The block is laid out as:
+ *
+ *   bytes 0 - 15   XOR mask of the first 16 bytes of WG message
+ *   byte  16       XOR mask of the padding length
+ *   byte  17       keepalive drop decision
+ *   byte  18       padding length
+ *   bytes 20 - 51  padding
+ *
+ * Bytes 0 to 16 are the same as the head PRN of v1, so the receiver restores
+ * v1 and v2 messages in the same way.
+ */
+enum wire_v2_offsets {
+        V2_HEAD_MASK = 0,
+        V2_LEN_MASK = 16,
+        V2_DROP = 17,
+        V2_RND_LEN = 18,
+        V2_RND = 20
+};
+
+/* per rule state, set up when the rule is inserted */
+struct wg_obfs_ctx {
+        struct wg_prf prf;
+        u8 wire_ver;
+        u8 udp_csum;
+        u8 padding;
+        struct wg_hs_limit *hs;         /* NULL without --hs-limit */
+        struct wg_obfs_rule_stats *stats;       /* NULL in revision 0 */
+};
+
+/* v1 needs the head PRN and usually 1 or 2 counter PRNs per packet */
+#define OBFS_BATCH 3
+
 struct obfs_buf {
         u8 chacha_in[CHACHA_INPUT_SIZE];
-        u8 chacha_out[MAX_RND_LEN];
+        u8 chacha_out[CHACHA20_BLOCK_SIZE];
         u8 rnd[MAX_RND_LEN];
         u8 rnd_len;
+        u8 nbatch;
+        u8 ibatch;
+        /* head and counter blocks hashed ahead by a SIMD backend */
+        u8 batch[OBFS_BATCH][CHACHA20_BLOCK_SIZE];
 };
 
+/* Blocks v1 --obfs usually hashes for a message: the head and a padding
+ * length, and the drop decision of a keepalive, the mac2 of a handshake, or a
+ * second padding length of a big data message, which only takes 4 to 8.
+ * Further ones are hashed one at a time.
+ */
+static unsigned int v1_blocks(const u8 *buf, const int len)
+{
+        if ((buf[0] == WG_HANDSHAKE_INIT && len == 148) ||
+            (buf[0] == WG_HANDSHAKE_RESP && len == 92) ||
+            (buf[0] == WG_DATA && (len == 32 || len > 200)))
+                return 3;
+
+        return 2;
+}
+
+/* With a SIMD backend, hash the head and the next counter inputs in one call,
+ * if there are enough of them for it to be faster than one by one.
+ */
+static void hash_v1_batch(const u8 *buf, struct obfs_buf *ob,
+                          const struct wg_prf *prf,
+                          const unsigned int nblocks)
+{
+        const unsigned int min = wg_prf_batch_min(prf);
+        u8 in[OBFS_BATCH][CHACHA_INPUT_SIZE];
+        unsigned int i;
+
+        if (!min || nblocks < min)
+                return;
+
+        memcpy(in[0], buf + 16, CHACHA_INPUT_SIZE);
+        for (i = 1; i < nblocks; i++) {
+                memcpy(in[i], ob->chacha_in, CHACHA_INPUT_SIZE);
+                in[i][0] += i;
+        }
+
+        wg_prf_hash_blocks(prf, in[0], ob->batch[0], nblocks);
+        ob->ibatch = 1;
+        ob->nbatch = nblocks;
+}
+
+/* Use the PRN of the unchanged 16th to 31st bytes of WG message as head PRN */
+static void hash_head(const u8 *buf, struct obfs_buf *ob,
+                      const struct wg_prf *prf)
+{
+        if (ob->nbatch)
+                memcpy(ob->chacha_out, ob->batch[0], HEAD_OBFS_WORDS * 4);
+        else
+                wg_prf_hash(prf, buf + 16, ob->chacha_out, HEAD_OBFS_WORDS);
+}
+
+/* increment the counter then hash it, or take it from the batch */
+static void hash_counter(struct obfs_buf *ob, const struct wg_prf *prf,
+                         u8 *out, const int out_words)
+{
+        u8 *counter = ob->chacha_in;
+
+        (*counter)++;
+        if (ob->ibatch < ob->nbatch) {
+                memcpy(out, ob->batch[ob->ibatch++], out_words * 4);
+                return;
+        }
+
+        wg_prf_hash(prf, ob->chacha_in, out, out_words);
+}
+
 /* get a pseudo-random string by hashing part of wg message */
-static u8 get_prn_insert(u8 *buf, struct obfs_buf *ob, const u8 *k,
-                         const u8 min_len, const u8 max_len)
+static u8 get_prn_insert(u8 *buf, struct obfs_buf *ob,
+                         const struct wg_prf *prf, const u8 min_len,
+                         const u8 max_len)
 {
         u8 r, i;
-        u8 *counter = ob->chacha_in;
+        int iters = 0;
 
         r = 0;
         while (1) {
-                (*counter)++;
-                chacha_hash(ob->chacha_in, k, ob->rnd, MAX_RND_WORDS);
+                iters++;
+                hash_counter(ob, prf, ob->rnd, MAX_RND_WORDS);
                 for (i = 0; i < MAX_RND_LEN; i++) {
                         if (ob->rnd[i] >= min_len && ob->rnd[i] <= max_len) {
                                 r = ob->rnd[i];
@@ -57,20 +170,42 @@ static u8 get_prn_insert(u8 *buf, struct obfs_buf *ob, const u8 *k,
         }
 
         ob->rnd_len = r;
+        trace_wgobfs_prn_insert(r, iters);
         return r;
 }
 
+/* v2: one chacha block for keepalive drop, padding length and padding, no
+ * rejection loop. Return -1 if the packet should be dropped.
+ */
+static int get_prn_v2(const u8 *buf, const int len, struct obfs_buf *ob,
+                      const struct wg_prf *prf, const u8 max_len)
+{
+        u8 span;
+
+        /* only hash the words that will be used */
+        wg_prf_hash(prf, buf + 16, ob->chacha_out,
+                    (V2_RND + max_len) / sizeof(u32));
+
+        /* same 0.8 drop probability as random_drop_wg_keepalive() */
+        if (buf[0] == WG_DATA && len == 32 && ob->chacha_out[V2_DROP] > 50)
+                return -1;
+
+        /* scale the byte into [MIN_RND_LEN, max_len] instead of rejecting */
+        span = max_len - MIN_RND_LEN + 1;
+        ob->rnd_len = MIN_RND_LEN + ((ob->chacha_out[V2_RND_LEN] * span) >> 8);
+        return 0;
+}
+
 /* Replace the all zeros mac2 with random bytes, then change the type field to
- * 0x11 or 0x12
+ * 0x11 or 0x12. Return the checksum of the new mac2.
  */
-static void obfs_mac2(u8 *buf, const int data_len, struct obfs_buf *ob,
-                      const u8 *k)
+static __wsum obfs_mac2(u8 *buf, const int data_len, struct obfs_buf *ob,
+                        const struct wg_prf *prf)
 {
         u8 type;
         struct wg_message_handshake_initiation *hsi;
         struct wg_message_handshake_response *hsr;
         u32 *np;
-        u8 *counter = ob->chacha_in;
 
         type = buf[0];
         if (type == WG_HANDSHAKE_INIT && data_len == 148) {
@@ -78,41 +213,43 @@ static void obfs_mac2(u8 *buf, const int data_len, struct obfs_buf *ob,
                 /* highly unlikely the first 4 bytes of cookie are all zeros */
                 np = (u32 *) hsi->macs.mac2;
                 if (*np)
-                        return;
+                        return 0;
 
                 /* Write 128bits PRN to mac2 */
-                (*counter)++;
-                chacha_hash(ob->chacha_in, k, hsi->macs.mac2, WG_COOKIE_WORDS);
+                hash_counter(ob, prf, hsi->macs.mac2, WG_COOKIE_WORDS);
 
                 /* mark the packet as need restore mac2 upon receiving */
                 buf[0] |= 0x10;
+                return csum_partial(hsi->macs.mac2, WG_COOKIE_LEN, 0);
 
         } else if (type == WG_HANDSHAKE_RESP && data_len == 92) {
                 hsr = (struct wg_message_handshake_response *) buf;
                 np = (u32 *) hsr->macs.mac2;
                 if (*np)
-                        return;
+                        return 0;
 
-                (*counter)++;
-                chacha_hash(ob->chacha_in, k, hsr->macs.mac2, WG_COOKIE_WORDS);
+                hash_counter(ob, prf, hsr->macs.mac2, WG_COOKIE_WORDS);
                 buf[0] |= 0x10;
+                return csum_partial(hsr->macs.mac2, WG_COOKIE_LEN, 0);
         }
+
+        return 0;
 }
 
 static int random_drop_wg_keepalive(u8 *buf, const int len,
-                                    struct obfs_buf *ob, const u8 *key)
+                                    struct obfs_buf *ob,
+                                    const struct wg_prf *prf)
 {
         u8 type = *buf;
-        u8 *counter = ob->chacha_in;
+        u8 prn[ONE_WORD * 4];
 
         if (type != WG_DATA || len != 32)
                 return 0;
 
         /* assume the probability of a 1 byte PRN > 50 is 0.8 */
-        (*counter)++;
-        chacha_hash(ob->chacha_in, key, ob->chacha_out, ONE_WORD);
+        hash_counter(ob, prf, prn, ONE_WORD);
 
-        if (ob->chacha_out[0] > 50)
+        if (prn[0] > 50)
                 return 1;
         else
                 return 0;
@@ -130,64 +267,205 @@ static int random_drop_wg_keepalive(u8 *buf, const int len,
  *     Orig_WG_message B1 B2 ... Bn
  *     Bn stores length of the padding.
  *
+ * The head PRN must already be in ob->chacha_out, and the padding already
+ * appended, it is in @pad too. Return the checksum of the new bytes minus that
+ * of the old ones.
  */
-static void obfs_wg(u8 *buf, const int len, struct obfs_buf *ob, const u8 *key)
+static __wsum obfs_wg(u8 *buf, const int len, struct obfs_buf *ob,
+                      const u8 *pad, const struct wg_prf *prf)
 {
+        __wsum old, new;
         u8 *b;
-        u8 rnd_len;
         int i;
 
-        obfs_mac2(buf, len, ob, key);
-        rnd_len = ob->rnd_len;
-        memcpy(buf + len, ob->rnd, rnd_len);
-
-        /* Use PRN to XOR with the first 16 bytes of WG message. It has message
-         * type, reserved field and counter. They look distinct.
-         */
-        chacha_hash(buf + 16, key, ob->chacha_out, HEAD_OBFS_WORDS);
-
-        /* set the last byte of random as its length */
-        buf[len + rnd_len - 1] = rnd_len ^ ob->chacha_out[16];
+        /* the mac2 of WG is all zeros, it adds nothing to the old sum */
+        old = csum_partial(buf, 16, 0);
+        new = obfs_mac2(buf, len, ob, prf);
         b = buf;
         for (i = 0; i < 16; i++, b++)
-                *b ^= ob->chacha_out[i];
+                *b ^= ob->chacha_out[V2_HEAD_MASK + i];
+
+        new = csum_add(new, csum_partial(buf, 16, 0));
+        new = csum_block_add(new, csum_partial(pad, ob->rnd_len, 0), len);
+        return csum_sub(new, old);
 }
 
-/* make a skb writable, and if necessary, expand it */
-static int prepare_skb_for_insert(struct sk_buff *skb, int ntail)
+/* Change the length in the IP and UDP header by @delta, and update the IP
+ * checksum. Return the checksum difference of the UDP length.
+ */
+static __wsum wg_obfs_set_len(struct iphdr *iph, struct udphdr *udph,
+                              const int delta)
 {
-        int extra_len;
+        __be16 new_len;
+        __wsum diff;
 
-        extra_len = ntail - skb_tailroom(skb);
-        if (extra_len > 0) {
-                if (pskb_expand_head(skb, 0, extra_len, GFP_ATOMIC))
-                        return -1;
-        }
+        new_len = htons(ntohs(iph->tot_len) + delta);
+        csum_replace2(&iph->check, iph->tot_len, new_len);
+        iph->tot_len = new_len;
+
+        new_len = htons(ntohs(udph->len) + delta);
+        diff = csum_sub((__force __wsum) new_len, (__force __wsum) udph->len);
+        udph->len = new_len;
+        return diff;
+}
 
+/* checksum the whole UDP datagram, which may be in page fragments */
+static void udp_csum_full(struct sk_buff *skb, const struct iphdr *iph,
+                          struct udphdr *udph)
+{
+        udph->check = 0;
+        udph->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+                                        ntohs(udph->len), IPPROTO_UDP,
+                                        skb_checksum(skb,
+                                                     skb_transport_offset(skb),
+                                                     ntohs(udph->len), 0));
+        if (!udph->check)
+                udph->check = CSUM_MANGLED_0;
+}
+
+/* Apply @diff, the checksum of the added bytes minus that of the removed
+ * ones, to the UDP checksum. A 0 checksum means none in UDP.
+ */
+static void udp_csum_update(struct udphdr *udph, const __wsum diff)
+{
+        udph->check = csum_fold(csum_add(diff, ~csum_unfold(udph->check)));
+        if (!udph->check)
+                udph->check = CSUM_MANGLED_0;
+}
+
+/* CHECKSUM_PARTIAL as UDP sets it up: the device sums the datagram from the
+ * UDP header into the check field, which holds the pseudo header sum.
+ */
+static bool udp_csum_offloaded(const struct sk_buff *skb)
+{
+        return skb->ip_summed == CHECKSUM_PARTIAL &&
+               skb->head + skb->csum_start == skb_transport_header(skb) &&
+               skb->csum_offset == offsetof(struct udphdr, check);
+}
+
+/* make the first @len bytes from skb->data writable */
+static int wg_obfs_make_writable(struct sk_buff *skb, const unsigned int len)
+{
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,3,0)
-        if (unlikely(skb_ensure_writable(skb, skb->len)))
+        return skb_ensure_writable(skb, len);
 #else
-        if (unlikely(!skb_make_writable(skb, skb->len)))
+        return skb_make_writable(skb, len) ? 0 : -ENOMEM;
+#endif
+}
+
+/* Append @len bytes to the packet. A linear skb takes them in its tailroom,
+ * a paged one in a new page fragment, so its pages are not copied.
+ */
+static int skb_append_trailer(struct sk_buff *skb, const u8 *trailer,
+                              const int len, struct wg_obfs_rule_stats *stats)
+{
+        int extra_len;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,5,0)
+        struct page *page;
+        u8 *p;
+
+        if (skb_is_nonlinear(skb) && !skb_has_frag_list(skb) &&
+            skb_shinfo(skb)->nr_frags < MAX_SKB_FRAGS) {
+                /* the frags array of a clone is shared, not its pages */
+                if (skb_cloned(skb)) {
+                        wg_obfs_stats_add(stats, XT_WGOBFS_STAT_EXPAND, 1);
+                        trace_wgobfs_expand(skb->len, skb_tailroom(skb), true,
+                                            true);
+                        if (pskb_expand_head(skb, 0, 0, GFP_ATOMIC))
+                                return -1;
+                }
+
+                p = netdev_alloc_frag(len);
+                if (!p)
+                        return -1;
+
+                memcpy(p, trailer, len);
+                page = virt_to_head_page(p);
+                skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
+                                p - (u8 *) page_address(page), len, len);
+                return 0;
+        }
 #endif
+
+        if (skb_linearize(skb))
                 return -1;
 
-        skb_put(skb, ntail);
+        /* so is the tailroom of a clone */
+        extra_len = len - skb_tailroom(skb);
+        if (extra_len > 0 || skb_cloned(skb)) {
+                wg_obfs_stats_add(stats, XT_WGOBFS_STAT_EXPAND, 1);
+                trace_wgobfs_expand(skb->len, skb_tailroom(skb),
+                                    skb_cloned(skb), false);
+                if (pskb_expand_head(skb, 0, max(extra_len, 0), GFP_ATOMIC))
+                        return -1;
+        }
+
+        memcpy(skb_put(skb, len), trailer, len);
         return 0;
 }
 
+/* --padding frag, the padding is a fragment of a shared page of random bytes
+ * if it does not fit in the tailroom. Only the length in its last byte comes
+ * from the PRN.
+ */
+static int skb_append_padding(struct sk_buff *skb, u8 *pad, const int len,
+                              const u8 last, const struct wg_obfs_ctx *ctx)
+{
+        if (ctx->padding == XT_WGOBFS_PADDING_FRAG &&
+            (skb_is_nonlinear(skb) || skb_cloned(skb) ||
+             skb_tailroom(skb) < len)) {
+                /* the frags array of a clone is shared */
+                if (!skb_cloned(skb) && !wg_pad_frag(skb, pad, len, last))
+                        return 0;
+        }
+
+        pad[len - 1] = last;
+        return skb_append_trailer(skb, pad, len, ctx->stats);
+}
+
 static unsigned int xt_obfs(struct sk_buff *skb,
-                            const struct xt_wg_obfs_info *info)
+                            const struct wg_obfs_ctx *ctx)
 {
+        const struct wg_prf *prf = &ctx->prf;
         struct obfs_buf ob;
         struct iphdr *iph;
-        struct udphdr *udph;
-        int wg_data_len, max_rnd_len;
+        struct udphdr *udph, _udph;
+        const struct udphdr *uh;
+        __wsum diff, len_diff;
+        int wg_data_len, max_rnd_len, wlen;
         u8 rnd_len;
         u8 *buf_udp;
+        const u8 *rnd;
+        u8 pad[MAX_RND_LEN];
+        u8 type;
+        enum xt_wgobfs_stat why;
+
+        /* the UDP header is not pulled yet on a paged or cloned skb */
+        uh = skb_header_pointer(skb, skb_transport_offset(skb),
+                                sizeof(struct udphdr), &_udph);
+        if (!uh) {
+                why = XT_WGOBFS_STAT_DROP_SHORT;
+                goto drop;
+        }
+
+        wg_data_len = ntohs(uh->len) - sizeof(struct udphdr);
+        if (wg_data_len < WG_MIN_LEN) {
+                why = XT_WGOBFS_STAT_DROP_SHORT;
+                goto drop;
+        }
+
+        /* Only the first 32 bytes of WG message, and the mac2 of a handshake,
+         * change in place. A cloned or paged skb is not copied as a whole.
+         */
+        wlen = wg_data_len > 148 ? WG_MIN_LEN : wg_data_len;
+        why = XT_WGOBFS_STAT_DROP_UNSHARE;
+        if (wg_obfs_make_writable(skb, skb_transport_offset(skb) +
+                                  sizeof(struct udphdr) + wlen))
+                goto drop;
 
         udph = udp_hdr(skb);
         buf_udp = (u8 *) udph + sizeof(struct udphdr);
-        wg_data_len = ntohs(udph->len) - sizeof(struct udphdr);
+        type = buf_udp[0];
 
         /* Use 16th to 31st bytes of WG message as input of chacha.
          *
@@ -208,147 +486,382 @@ static unsigned int xt_obfs(struct sk_buff *skb,
          * Other PRNs will be generated with incremented counter.
          */
         ob.chacha_in[0] += 42;
-
-        if (random_drop_wg_keepalive(buf_udp, wg_data_len, &ob, info->chacha_key))
-                return NF_DROP;
+        ob.nbatch = 0;
+        ob.ibatch = 0;
 
         /* Insert a long pseudo-random string if the WG packet is small, or a
          * short string if WG packet is big.
          */
         max_rnd_len = (wg_data_len > 200) ? 8 : MAX_RND_LEN;
-        rnd_len = get_prn_insert(buf_udp, &ob, info->chacha_key,
-                                 MIN_RND_LEN, max_rnd_len);
-        ob.rnd_len = rnd_len;
-        if (prepare_skb_for_insert(skb, rnd_len))
-                return NF_DROP;
+        if (ctx->wire_ver == XT_WGOBFS_WIRE_V2) {
+                if (get_prn_v2(buf_udp, wg_data_len, &ob, prf, max_rnd_len))
+                        goto keepalive;
+
+                rnd = ob.chacha_out + V2_RND;
+        } else {
+                hash_v1_batch(buf_udp, &ob, prf,
+                              v1_blocks(buf_udp, wg_data_len));
+                if (random_drop_wg_keepalive(buf_udp, wg_data_len, &ob, prf))
+                        goto keepalive;
+
+                get_prn_insert(buf_udp, &ob, prf, MIN_RND_LEN, max_rnd_len);
+                rnd = ob.rnd;
+
+                /* Use PRN to XOR with the first 16 bytes of WG message. It has
+                 * message type, reserved field and counter. They look
+                 * distinct.
+                 */
+                hash_head(buf_udp, &ob, prf);
+        }
+
+        /* set the last byte of random as its length */
+        rnd_len = ob.rnd_len;
+        memcpy(pad, rnd, rnd_len);
+        if (skb_append_padding(skb, pad, rnd_len,
+                               rnd_len ^ ob.chacha_out[V2_LEN_MASK], ctx))
+                goto drop;
 
         udph = udp_hdr(skb);
         buf_udp = (u8 *) udph + sizeof(struct udphdr);
-        obfs_wg(buf_udp, wg_data_len, &ob, info->chacha_key);
+        diff = obfs_wg(buf_udp, wg_data_len, &ob, pad, prf);
 
         /* packet with DiffServ 0x88 looks distinct? */
         iph = ip_hdr(skb);
-        iph->tos = 0;
+        ipv4_change_dsfield(iph, 0, 0);
 
-        /* recalculate ip header checksum */
-        iph->tot_len = htons(ntohs(iph->tot_len) + rnd_len);
-        iph->check = 0;
-        ip_send_check(iph);
+        /* the length is in the UDP header and in the pseudo header */
+        len_diff = wg_obfs_set_len(iph, udph, rnd_len);
+        diff = csum_add(diff, csum_add(len_diff, len_diff));
 
         /* CHECKSUM_PARTIAL: The driver is required to checksum the packet.
-         * With CHECKSUM_PARTIAL, the udp packet has good checksum in VM, bad
-         * checksum after leave VM. Set to CHECKSUM_NONE fixes the problem.
+         * The check field only has the pseudo header sum, the driver adds the
+         * datagram to it. Only the length in the pseudo header changed. A full
+         * checksum written here would be added to, which is how packets used
+         * to leave a VM with bad checksums.
+         *
+         * --udp-csum sw computes it here for drivers that get offload wrong,
+         * and a 0 check field has nothing to update. Otherwise only the head,
+         * mac2, padding and length changed.
+         *
+         * A 0 checksum is fine in IPv4 UDP, and WG authenticates the message.
          */
-        if (skb->ip_summed == CHECKSUM_PARTIAL)
+        if (ctx->udp_csum == XT_WGOBFS_UDP_CSUM_NONE) {
+                skb->ip_summed = CHECKSUM_NONE;
+                udph->check = 0;
+        } else if (ctx->udp_csum != XT_WGOBFS_UDP_CSUM_SW &&
+                   udp_csum_offloaded(skb)) {
+                udph->check = ~csum_fold(csum_add(csum_unfold(udph->check),
+                                                  len_diff));
+        } else if (skb->ip_summed == CHECKSUM_PARTIAL || !udph->check) {
                 skb->ip_summed = CHECKSUM_NONE;
+                udp_csum_full(skb, iph, udph);
+        } else {
+                udp_csum_update(udph, diff);
+        }
 
-        /* recalculate udp header checksum */
-        udph->len = htons(ntohs(udph->len) + rnd_len);
-        udph->check = 0;
-        udph->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
-                                        ntohs(udph->len), IPPROTO_UDP,
-                                        csum_partial((char *) udph,
-                                                     ntohs(udph->len), 0));
+        wg_obfs_stats_add(ctx->stats, XT_WGOBFS_STAT_OBFS_PKTS, 1);
+        wg_obfs_stats_add(ctx->stats, XT_WGOBFS_STAT_OBFS_BYTES, skb->len);
+        wg_obfs_stats_add(ctx->stats, XT_WGOBFS_STAT_PAD_BYTES, rnd_len);
+        trace_wgobfs_obfs(type, wg_data_len, rnd_len, ctx->wire_ver);
         return XT_CONTINUE;
+
+keepalive:
+        why = XT_WGOBFS_STAT_KEEPALIVE_DROP;
+drop:
+        wg_obfs_stats_add(ctx->stats, why, 1);
+        trace_wgobfs_drop(XT_MODE_OBFS, skb->len, why);
+        return NF_DROP;
 }
 
-static void restore_mac2(u8 *buf)
+/* return the checksum of the mac2 that is cleared */
+static __wsum restore_mac2(u8 *buf)
 {
         struct wg_message_handshake_initiation *hsi;
         struct wg_message_handshake_response *hsr;
         static u8 zero_mac2[WG_COOKIE_LEN];
+        __wsum old = 0;
 
         /* mac2 was all zeros before obfscation, reset it back to zeros */
         switch (buf[0]) {
         case OBFS_WG_HANDSHAKE_INIT:
                 hsi = (struct wg_message_handshake_initiation *) buf;
+                old = csum_partial(hsi->macs.mac2, WG_COOKIE_LEN, 0);
                 /* memcpy is faster than memset, 860 vs 847 Mbits/s */
                 memcpy(hsi->macs.mac2, zero_mac2, WG_COOKIE_LEN);
                 break;
         case OBFS_WG_HANDSHAKE_RESP:
                 hsr = (struct wg_message_handshake_response *) buf;
+                old = csum_partial(hsr->macs.mac2, WG_COOKIE_LEN, 0);
                 memcpy(hsr->macs.mac2, zero_mac2, WG_COOKIE_LEN);
                 break;
         }
 
         buf[0] &= 0x0F;
+        return old;
 }
 
-static int restore_wg(u8 *buf, int len, const u8 *key)
+/* Restore the first 16 bytes, and the mac2, of WG message in place, with the
+ * head PRN in @buf_prn. Return the checksum of the restored bytes minus that
+ * of the obfuscated ones.
+ */
+static __wsum restore_wg(u8 *buf, const u8 *buf_prn)
 {
-        u8 buf_prn[MAX_RND_LEN];
         u8 *head;
-        int i, rnd_len;
+        __wsum old;
+        int i;
 
-        /* Same as obfuscate, generate the same PRN from 16th to 31st bytes of
-         * WG message. Need it for restoring the first 16 bytes of WG message.
-         */
-        chacha_hash(buf + 16, key, buf_prn, HEAD_OBFS_WORDS);
+        old = csum_partial(buf, 16, 0);
+
+        /* restore the first 16 bytes of WG packet */
+        head = buf;
+        for (i = 0; i < 16; i++, head++)
+                *head ^= buf_prn[i];
+
+        old = csum_add(old, restore_mac2(buf));
+        return csum_sub(csum_partial(buf, 16, 0), old);
+}
+
+/* Check that the head PRN decodes the packet into a WG message, before
+ * anything is written. Junk sent to the port costs one hash. Return the
+ * padding length, or -1 with the reason in @why.
+ */
+static int unobfs_check(const struct sk_buff *skb, const unsigned int off,
+                        const int data_len, const u8 *buf_prn, u8 *type,
+                        enum xt_wgobfs_stat *why)
+{
+        u8 peek[4];
+        const u8 *p;
+        int rnd_len, msg_len;
 
         /* Restore the length of random padding. It is stored in the last byte
-         * of obfuscated WG.
+         * of obfuscated WG, which is trimmed with the padding.
          */
-        buf[len - 1] ^= buf_prn[16];
+        *why = XT_WGOBFS_STAT_DROP_BAD_PAD;
+        p = skb_header_pointer(skb, off + data_len - 1, 1, peek);
+        if (!p)
+                return -1;
 
-        rnd_len = (int) buf[len - 1];
-        if (rnd_len + WG_MIN_LEN > len)
+        rnd_len = *p ^ buf_prn[16];
+        if (rnd_len < MIN_RND_LEN || rnd_len > MAX_RND_LEN)
                 return -1;
 
-        /* restore the first 16 bytes of WG packet */
-        head = buf;
-        for (i = 0; i < 16; i++, head++)
-                *head ^= buf_prn[i];
+        *why = XT_WGOBFS_STAT_DROP_INVALID;
+        /* message type, then 3 reserved zero bytes */
+        p = skb_header_pointer(skb, off, 4, peek);
+        if (!p || p[1] != buf_prn[1] || p[2] != buf_prn[2] ||
+            p[3] != buf_prn[3])
+                return -1;
+
+        msg_len = data_len - rnd_len;
+        *type = p[0] ^ buf_prn[0];
+        switch (*type) {
+        case WG_HANDSHAKE_INIT:
+        case OBFS_WG_HANDSHAKE_INIT:
+                if (msg_len != sizeof(struct wg_message_handshake_initiation))
+                        return -1;
+                break;
+        case WG_HANDSHAKE_RESP:
+        case OBFS_WG_HANDSHAKE_RESP:
+                if (msg_len != sizeof(struct wg_message_handshake_response))
+                        return -1;
+                break;
+        case WG_COOKIE:
+                if (msg_len != sizeof(struct wg_message_handshake_cookie))
+                        return -1;
+                break;
+        case WG_DATA:
+                /* the encrypted data is padded to 16 bytes */
+                if (msg_len < WG_MIN_LEN || msg_len % 16)
+                        return -1;
+                break;
+        default:
+                return -1;
+        }
 
-        restore_mac2(buf);
         return rnd_len;
 }
 
 static unsigned int xt_unobfs(struct sk_buff *skb,
-                              const struct xt_wg_obfs_info *info)
+                              const struct wg_obfs_ctx *ctx)
 {
         struct iphdr *iph;
-        struct udphdr *udph;
+        struct udphdr *udph, _udph;
+        const struct udphdr *uh;
+        u8 buf_prn[MAX_RND_LEN];
+        u8 peek[CHACHA_INPUT_SIZE];
+        const u8 *p;
         u8 *buf_udp;
-        int data_len;
+        u8 type;
+        enum xt_wgobfs_stat why;
+        __wsum diff, len_diff, pad_sum;
+        unsigned int off;
+        int data_len, wlen;
         int rnd_len;
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,3,0)
-        if (unlikely(skb_ensure_writable(skb, skb->len)))
-#else
-        if (unlikely(!skb_make_writable(skb, skb->len)))
-#endif
-                return NF_DROP;
+        /* nothing has pulled the UDP header into the linear area */
+        uh = skb_header_pointer(skb, skb_transport_offset(skb),
+                                sizeof(struct udphdr), &_udph);
+        if (!uh) {
+                why = XT_WGOBFS_STAT_DROP_SHORT;
+                goto drop;
+        }
 
-        udph = udp_hdr(skb);
-        buf_udp = (u8 *) udph + sizeof(struct udphdr);
-        data_len = ntohs(udph->len) - sizeof(struct udphdr);
-        /* random bytes insertion adds at least 4 bytes */
-        if (data_len < MIN_RND_LEN)
-                return NF_DROP;
+        off = skb_transport_offset(skb) + sizeof(struct udphdr);
+        data_len = ntohs(uh->len) - sizeof(struct udphdr);
+        /* the padding is at the end of the datagram */
+        if (data_len < WG_MIN_LEN || off + data_len != skb->len) {
+                why = XT_WGOBFS_STAT_DROP_SHORT;
+                goto drop;
+        }
 
-        rnd_len = restore_wg(buf_udp, data_len, info->chacha_key);
+        /* Same as obfuscate, generate the same PRN from 16th to 31st bytes of
+         * WG message. Need it for restoring the first 16 bytes of WG message.
+         */
+        p = skb_header_pointer(skb, off + 16, CHACHA_INPUT_SIZE, peek);
+        if (!p) {
+                why = XT_WGOBFS_STAT_DROP_SHORT;
+                goto drop;
+        }
+
+        wg_prf_hash(&ctx->prf, p, buf_prn, HEAD_OBFS_WORDS);
+
+        rnd_len = unobfs_check(skb, off, data_len, buf_prn, &type, &why);
         if (rnd_len < 0)
-                return NF_DROP;
+                goto drop;
+
+        /* shed handshake storms before WG does the Curve25519 work */
+        if (ctx->hs && ((type & 0x0F) == WG_HANDSHAKE_INIT ||
+                        (type & 0x0F) == WG_HANDSHAKE_RESP) &&
+            !wg_hs_limit_allow(ctx->hs, ip_hdr(skb)->saddr)) {
+                why = XT_WGOBFS_STAT_DROP_HS_LIMIT;
+                goto drop;
+        }
 
-        skb->len -= rnd_len;
-        skb->tail -= rnd_len;
+        /* Only the head, and the mac2 of a handshake, are written. The
+         * payload of a cloned or paged skb is not copied.
+         */
+        switch (type) {
+        case OBFS_WG_HANDSHAKE_INIT:
+                wlen = sizeof(struct wg_message_handshake_initiation);
+                break;
+        case OBFS_WG_HANDSHAKE_RESP:
+                wlen = sizeof(struct wg_message_handshake_response);
+                break;
+        default:
+                wlen = 16;
+        }
+
+        why = XT_WGOBFS_STAT_DROP_UNSHARE;
+        if (unlikely(wg_obfs_make_writable(skb, off + wlen)))
+                goto drop;
+
+        buf_udp = skb->data + off;
+        diff = restore_wg(buf_udp, buf_prn);
+
+        /* the padding, at its offset in the datagram */
+        pad_sum = 0;
+        if (udp_hdr(skb)->check || skb->ip_summed == CHECKSUM_COMPLETE)
+                pad_sum = csum_block_add(0, skb_checksum(skb, off + data_len -
+                                                         rnd_len, rnd_len, 0),
+                                         data_len - rnd_len);
+
+        /* Depending on the kernel, pskb_trim_rcsum() takes the padding out of
+         * skb->csum or falls back to CHECKSUM_NONE. It is trimmed first, so
+         * what is left to apply below is the same on every kernel.
+         */
+        if (pskb_trim_rcsum(skb, off + data_len - rnd_len))
+                goto drop;
 
-        /* recalculate ip header checksum */
         iph = ip_hdr(skb);
-        iph->tot_len = htons(ntohs(iph->tot_len) - rnd_len);
-        iph->check = 0;
-        ip_send_check(iph);
+        udph = udp_hdr(skb);
+        len_diff = wg_obfs_set_len(iph, udph, -rnd_len);
 
-        /* recalculate udp header checksum */
-        udph->len = htons(ntohs(udph->len) - rnd_len);
-        udph->check = 0;
-        udph->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
-                                        ntohs(udph->len), IPPROTO_UDP,
-                                        csum_partial((char *) udph,
-                                                     ntohs(udph->len), 0));
+        /* A bad checksum stays bad, UDP drops the packet as it would have
+         * without the obfuscation. A 0 checksum means the peer sent none.
+         *
+         * CHECKSUM_UNNECESSARY stays true, the checksum is exactly as good as
+         * the one the NIC verified. With CHECKSUM_COMPLETE, skb->csum covers
+         * the IP header, whose sum is unchanged, and the UDP datagram, now
+         * without the padding. The datagram changes by @diff and the length
+         * field, and the check field takes all of that back, plus the
+         * padding and the pseudo header length. UDP then verifies the
+         * restored packet without reading it.
+         */
+        if (udph->check) {
+                udp_csum_update(udph, csum_add(csum_sub(diff, pad_sum),
+                                               csum_add(len_diff, len_diff)));
+                if (skb->ip_summed == CHECKSUM_COMPLETE)
+                        skb->csum = csum_add(skb->csum,
+                                             csum_sub(pad_sum, len_diff));
+        } else if (skb->ip_summed == CHECKSUM_COMPLETE) {
+                skb->csum = csum_add(skb->csum, csum_add(diff, len_diff));
+        }
+
+        wg_obfs_stats_add(ctx->stats, XT_WGOBFS_STAT_UNOBFS_PKTS, 1);
+        wg_obfs_stats_add(ctx->stats, XT_WGOBFS_STAT_UNOBFS_BYTES, skb->len);
+        trace_wgobfs_unobfs(type, data_len - rnd_len, rnd_len);
         return XT_CONTINUE;
+
+drop:
+        wg_obfs_stats_add(ctx->stats, why, 1);
+        trace_wgobfs_drop(XT_MODE_UNOBFS, skb->len, why);
+        return NF_DROP;
+}
+
+/* a sampled packet, the type is peeked before --obfs masks it and after
+ * --unobfs restores it
+ */
+static noinline unsigned int
+wg_obfs_target_lat(struct sk_buff *skb, const u8 mode,
+                   const struct wg_obfs_ctx *ctx, const u64 start)
+{
+        const int off = skb_transport_offset(skb) + sizeof(struct udphdr);
+        const unsigned int len = skb->len;
+        unsigned int ret;
+        u8 type = 0, buf, *p;
+
+        if (mode == XT_MODE_OBFS) {
+                p = skb_header_pointer(skb, off, 1, &buf);
+                if (p)
+                        type = *p;
+                ret = xt_obfs(skb, ctx);
+        } else {
+                ret = xt_unobfs(skb, ctx);
+                p = skb_header_pointer(skb, off, 1, &buf);
+                if (ret != NF_DROP && p)
+                        type = *p;
+        }
+
+        wg_obfs_lat_end(start, mode, type, len);
+        return ret;
 }
 
+unsigned int wg_obfs_target(struct sk_buff *skb, const u8 mode,
+                            const struct wg_obfs_ctx *ctx)
+{
+        struct iphdr *iph;
+        u64 start;
+
+        iph = ip_hdr(skb);
+        /* only work with UDP so far, may obfuscate UDP into TCP later */
+        if (iph->protocol != IPPROTO_UDP)
+                return XT_CONTINUE;
+
+        if (wg_obfs_lat_enabled() && mode <= XT_MODE_UNOBFS) {
+                start = wg_obfs_lat_start();
+                if (start)
+                        return wg_obfs_target_lat(skb, mode, ctx, start);
+        }
+
+        if (mode == XT_MODE_OBFS)
+                return xt_obfs(skb, ctx);
+        else if (mode == XT_MODE_UNOBFS)
+                return xt_unobfs(skb, ctx);
+
+        return XT_CONTINUE;
+}
+EXPORT_SYMBOL_GPL(wg_obfs_target);
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
 static unsigned int
 xt_wg_obfs_target(struct sk_buff *skb, const struct xt_action_param *par)
@@ -358,64 +871,303 @@ xt_wg_obfs_target(struct sk_buff *skb, const struct xt_target_param *par)
 #endif
 {
         const struct xt_wg_obfs_info *info = par->targinfo;
-        struct iphdr *iph;
-
-        iph = ip_hdr(skb);
-        /* only work with UDP so far, may obfuscate UDP into TCP later */
-        if (iph->protocol != IPPROTO_UDP)
-                return XT_CONTINUE;
+        struct wg_obfs_ctx ctx = {
+                .wire_ver = XT_WGOBFS_WIRE_V1,
+                .udp_csum = XT_WGOBFS_UDP_CSUM_KEEP,
+                .padding = XT_WGOBFS_PADDING_COPY,
+        };
+
+        /* revision 0 has no room for a precomputed state */
+        wg_prf_init(&ctx.prf, XT_WGOBFS_PRF_CHACHA, info->chacha_key,
+                    XT_WGOBFS_DEFAULT_ROUNDS);
+        return wg_obfs_target(skb, info->mode, &ctx);
+}
 
-        if (info->mode == XT_MODE_OBFS)
-                return xt_obfs(skb, info);
-        else if (info->mode == XT_MODE_UNOBFS)
-                return xt_unobfs(skb, info);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
+static unsigned int
+xt_wg_obfs_target_v1(struct sk_buff *skb, const struct xt_action_param *par)
+#else
+static unsigned int
+xt_wg_obfs_target_v1(struct sk_buff *skb, const struct xt_target_param *par)
+#endif
+{
+        const struct xt_wg_obfs_info_v1 *info = par->targinfo;
 
-        return XT_CONTINUE;
+        return wg_obfs_target(skb, info->mode, info->ctx);
 }
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,35)
-static int xt_wg_obfs_checkentry(const struct xt_tgchk_param *par)
+static bool wg_obfs_check_table(const struct xt_tgchk_param *par)
 {
         if (strcmp(par->table, "mangle")) {
                 printk(KERN_WARNING
                        "WGOBFS: can only be called from mangle table\n");
+                return false;
+        }
+
+        return true;
+}
+
+int wg_obfs_info_check(const struct xt_wg_obfs_info_v1 *info)
+{
+        if (info->mode != XT_MODE_OBFS && info->mode != XT_MODE_UNOBFS) {
+                printk(KERN_WARNING "WGOBFS: unknown mode %u\n", info->mode);
+                return -EINVAL;
+        }
+
+        if (info->wire_ver != XT_WGOBFS_WIRE_V1 &&
+            info->wire_ver != XT_WGOBFS_WIRE_V2) {
+                printk(KERN_WARNING "WGOBFS: unknown wire format v%u\n",
+                       info->wire_ver);
+                return -EINVAL;
+        }
+
+        if (!chacha_rounds_valid(info->rounds)) {
+                printk(KERN_WARNING "WGOBFS: unsupported chacha rounds %u\n",
+                       info->rounds);
+                return -EINVAL;
+        }
+
+        if (!wg_prf_valid(info->prf)) {
+                printk(KERN_WARNING "WGOBFS: unknown prf %u\n", info->prf);
+                return -EINVAL;
+        }
+
+        if (info->udp_csum > XT_WGOBFS_UDP_CSUM_SW) {
+                printk(KERN_WARNING "WGOBFS: unknown udp-csum %u\n",
+                       info->udp_csum);
+                return -EINVAL;
+        }
+
+        if (info->padding > XT_WGOBFS_PADDING_FRAG) {
+                printk(KERN_WARNING "WGOBFS: unknown padding %u\n",
+                       info->padding);
+                return -EINVAL;
+        }
+
+        if (info->hs_rate &&
+            (info->hs_rate > XT_WGOBFS_HS_MAX || !info->hs_burst ||
+             info->hs_burst > XT_WGOBFS_HS_MAX)) {
+                printk(KERN_WARNING "WGOBFS: bad hs-limit %u/s burst %u\n",
+                       info->hs_rate, info->hs_burst);
                 return -EINVAL;
         }
 
         return 0;
 }
-#else
-static bool xt_wg_obfs_checkentry(const struct xt_tgchk_param *par)
+EXPORT_SYMBOL_GPL(wg_obfs_info_check);
+
+int wg_obfs_ctx_create(struct net *net, struct xt_wg_obfs_info_v1 *info)
 {
-        if (strcmp(par->table, "mangle")) {
-                printk(KERN_WARNING
-                       "WGOBFS: can only be called from mangle table\n");
-                return false;
+        struct wg_obfs_ctx *ctx;
+
+        ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+        if (!ctx)
+                return -ENOMEM;
+
+        wg_prf_init(&ctx->prf, info->prf, info->chacha_key, info->rounds);
+        ctx->wire_ver = info->wire_ver;
+        ctx->udp_csum = info->udp_csum;
+        ctx->padding = info->padding;
+        ctx->hs = NULL;
+        if (info->mode == XT_MODE_UNOBFS && info->hs_rate) {
+                ctx->hs = wg_hs_limit_create(info->hs_rate, info->hs_burst);
+                if (!ctx->hs) {
+                        kfree(ctx);
+                        return -ENOMEM;
+                }
         }
 
+        ctx->stats = wg_obfs_stats_create(net, info->mode);
+        if (!ctx->stats) {
+                wg_hs_limit_destroy(ctx->hs);
+                kfree(ctx);
+                return -ENOMEM;
+        }
+
+        info->id = ctx->stats->id;
+        info->ctx = ctx;
+        return 0;
+}
+EXPORT_SYMBOL_GPL(wg_obfs_ctx_create);
+
+void wg_obfs_ctx_destroy(struct wg_obfs_ctx *ctx)
+{
+        wg_obfs_stats_destroy(ctx->stats);
+        wg_hs_limit_destroy(ctx->hs);
+        kfree(ctx);
+}
+EXPORT_SYMBOL_GPL(wg_obfs_ctx_destroy);
+
+void wg_obfs_info_init(struct xt_wg_obfs_info_v1 *info)
+{
+        memset(info, 0, sizeof(*info));
+        info->wire_ver = XT_WGOBFS_WIRE_V1;
+        info->rounds = XT_WGOBFS_DEFAULT_ROUNDS;
+        info->prf = XT_WGOBFS_PRF_CHACHA;
+        info->udp_csum = XT_WGOBFS_UDP_CSUM_KEEP;
+        info->padding = XT_WGOBFS_PADDING_COPY;
+        info->hs_burst = XT_WGOBFS_HS_BURST;
+}
+EXPORT_SYMBOL_GPL(wg_obfs_info_init);
+
+/* as libxt_WGOBFS, the key is repeated up to the chacha key size */
+int wg_obfs_info_set_key(struct xt_wg_obfs_info_v1 *info, const char *s,
+                         const size_t len)
+{
+        int i;
+
+        if (!len || len > XT_WGOBFS_MAX_KEY_SIZE)
+                return -EINVAL;
+
+        memcpy(info->key, s, len);
+        info->key[len] = '\0';
+        for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+                info->chacha_key[i] = s[i % len];
+
+        return 0;
+}
+EXPORT_SYMBOL_GPL(wg_obfs_info_set_key);
+
+/* an IPv4 UDP packet that is not a fragment, with both headers in the linear
+ * part. The hooks of nft netdev chains and tc run before ip_rcv(), the
+ * transport header is set and an Ethernet trailer trimmed here.
+ */
+bool wg_obfs_skb_udp4(struct sk_buff *skb, const int nhoff)
+{
+        const struct iphdr *iph;
+        unsigned int thoff, len;
+
+        if (skb->protocol != htons(ETH_P_IP) || skb_is_gso(skb) ||
+            !pskb_may_pull(skb, nhoff + sizeof(*iph)))
+                return false;
+
+        iph = ip_hdr(skb);
+        thoff = nhoff + iph->ihl * 4;
+        len = nhoff + ntohs(iph->tot_len);
+        if (iph->version != 4 || iph->ihl < 5 ||
+            iph->protocol != IPPROTO_UDP || ip_is_fragment(iph) ||
+            len < thoff + sizeof(struct udphdr) || skb->len < len ||
+            !pskb_may_pull(skb, thoff + sizeof(struct udphdr)))
+                return false;
+
+        if (skb->len > len && pskb_trim_rcsum(skb, len))
+                return false;
+
+        skb_set_transport_header(skb, thoff);
         return true;
 }
+EXPORT_SYMBOL_GPL(wg_obfs_skb_udp4);
+
+static int wg_obfs_check_v1(const struct xt_tgchk_param *par)
+{
+        struct xt_wg_obfs_info_v1 *info = par->targinfo;
+        int ret;
+
+        if (!wg_obfs_check_table(par))
+                return -EINVAL;
+
+        ret = wg_obfs_info_check(info);
+        if (ret)
+                return ret;
+
+        return wg_obfs_ctx_create(par->net, info);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,35)
+static int xt_wg_obfs_checkentry(const struct xt_tgchk_param *par)
+{
+        return wg_obfs_check_table(par) ? 0 : -EINVAL;
+}
+
+static int xt_wg_obfs_checkentry_v1(const struct xt_tgchk_param *par)
+{
+        return wg_obfs_check_v1(par);
+}
+#else
+static bool xt_wg_obfs_checkentry(const struct xt_tgchk_param *par)
+{
+        return wg_obfs_check_table(par);
+}
+
+static bool xt_wg_obfs_checkentry_v1(const struct xt_tgchk_param *par)
+{
+        return wg_obfs_check_v1(par) == 0;
+}
 #endif
 
-static struct xt_target xt_wg_obfs = {
-        .name = "WGOBFS",
-        .revision = 0,
-        .family = NFPROTO_IPV4,
-        .table = "mangle",
-        .target = xt_wg_obfs_target,
-        .targetsize = XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
-        .checkentry = xt_wg_obfs_checkentry,
-        .me = THIS_MODULE,
+static void xt_wg_obfs_destroy_v1(const struct xt_tgdtor_param *par)
+{
+        struct xt_wg_obfs_info_v1 *info = par->targinfo;
+
+        wg_obfs_ctx_destroy(info->ctx);
+}
+
+static struct xt_target xt_wg_obfs[] __read_mostly = {
+        {
+                .name = "WGOBFS",
+                .revision = 0,
+                .family = NFPROTO_IPV4,
+                .table = "mangle",
+                .target = xt_wg_obfs_target,
+                .targetsize = XT_ALIGN(sizeof(struct xt_wg_obfs_info)),
+                .checkentry = xt_wg_obfs_checkentry,
+                .me = THIS_MODULE,
+        },
+        {
+                .name = "WGOBFS",
+                .revision = 1,
+                .family = NFPROTO_IPV4,
+                .table = "mangle",
+                .target = xt_wg_obfs_target_v1,
+                .targetsize = XT_ALIGN(sizeof(struct xt_wg_obfs_info_v1)),
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+                .usersize = offsetof(struct xt_wg_obfs_info_v1, ctx),
+#endif
+                .checkentry = xt_wg_obfs_checkentry_v1,
+                .destroy = xt_wg_obfs_destroy_v1,
+                .me = THIS_MODULE,
+        },
 };
 
+/* older kernels gave the suites of a module a module_init of their own */
+#if defined(WGOBFS_KUNIT) && LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+#include "selftest.c"
+#endif
+
 static int __init wg_obfs_target_init(void)
 {
-        return xt_register_target(&xt_wg_obfs);
+        int ret;
+
+        ret = chacha_select_backend();
+        if (ret)
+                return ret;
+
+        wg_prf_setup();
+        ret = wg_obfs_stats_init();
+        if (ret)
+                goto err_stats;
+
+        wg_obfs_lat_init();
+        ret = xt_register_targets(xt_wg_obfs, ARRAY_SIZE(xt_wg_obfs));
+        if (ret)
+                goto err_xt;
+
+        return 0;
+
+err_xt:
+        wg_obfs_lat_exit();
+        wg_obfs_stats_exit();
+err_stats:
+        wg_pad_frag_exit();
+        return ret;
 }
 
 static void __exit wg_obfs_target_exit(void)
 {
-        xt_unregister_target(&xt_wg_obfs);
+        xt_unregister_targets(xt_wg_obfs, ARRAY_SIZE(xt_wg_obfs));
+        wg_obfs_lat_exit();
+        wg_obfs_stats_exit();
+        wg_pad_frag_exit();
 }
 
 module_init(wg_obfs_target_init);
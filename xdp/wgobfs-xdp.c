@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Attach the XDP program of --unobfs to an interface and manage its keys.
+ *
+ *   wgobfs-xdp attach <dev> [--generic] [--obj <path>]
+ *   wgobfs-xdp detach <dev> [--generic]
+ *   wgobfs-xdp add --sport|--dport <port> --key <key> [--rounds <n>]
+ *   wgobfs-xdp delete --sport|--dport <port>
+ *   wgobfs-xdp list
+ *   wgobfs-xdp stats
+ *
+ * The maps are pinned in WGOBFS_XDP_PIN_DIR, they outlive this program and
+ * are shared by all the interfaces.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <linux/if_link.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "wgobfs_xdp.h"
+
+#ifndef WGOBFS_XDP_OBJ
+#define WGOBFS_XDP_OBJ "/usr/local/lib/bpf/wgobfs_xdp.o"
+#endif
+
+#define KEYS_PIN WGOBFS_XDP_PIN_DIR "/wgobfs_keys"
+#define STATS_PIN WGOBFS_XDP_PIN_DIR "/wgobfs_stats"
+
+enum {
+	OPT_GENERIC = 1,
+	OPT_OBJ,
+	OPT_SPORT,
+	OPT_DPORT,
+	OPT_KEY,
+	OPT_ROUNDS
+};
+
+static const struct option opts[] = {
+	{ "generic", no_argument, NULL, OPT_GENERIC },
+	{ "obj", required_argument, NULL, OPT_OBJ },
+	{ "sport", required_argument, NULL, OPT_SPORT },
+	{ "dport", required_argument, NULL, OPT_DPORT },
+	{ "key", required_argument, NULL, OPT_KEY },
+	{ "rounds", required_argument, NULL, OPT_ROUNDS },
+	{ NULL, 0, NULL, 0 }
+};
+
+/* the counters the XDP program updates */
+static const struct {
+	int stat;
+	const char *name;
+} stats[] = {
+	{ XT_WGOBFS_STAT_UNOBFS_PKTS, "unobfs_pkts" },
+	{ XT_WGOBFS_STAT_UNOBFS_BYTES, "unobfs_bytes" },
+	{ XT_WGOBFS_STAT_DROP_UNSHARE, "drop_unshare" },
+	{ XT_WGOBFS_STAT_DROP_SHORT, "drop_short" },
+	{ XT_WGOBFS_STAT_DROP_BAD_PAD, "drop_bad_pad" },
+	{ XT_WGOBFS_STAT_DROP_INVALID, "drop_invalid" },
+};
+
+static const char *prog;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: %s attach <dev> [--generic] [--obj <path>]\n"
+		"       %s detach <dev> [--generic]\n"
+		"       %s add --sport|--dport <port> --key <key>"
+		" [--rounds <4|6|8|12>]\n"
+		"       %s delete --sport|--dport <port>\n"
+		"       %s list\n"
+		"       %s stats\n",
+		prog, prog, prog, prog, prog, prog);
+	exit(2);
+}
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "wgobfs-xdp: %s\n", msg);
+	exit(1);
+}
+
+static void die_errno(const char *what)
+{
+	fprintf(stderr, "wgobfs-xdp: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static long parse_num(const char *s, long min, long max, const char *what)
+{
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(s, &end, 10);
+	if (errno || *end || end == s || n < min || n > max) {
+		fprintf(stderr, "wgobfs-xdp: bad %s %s\n", what, s);
+		exit(2);
+	}
+
+	return n;
+}
+
+static int map_open(const char *path)
+{
+	int fd = bpf_obj_get(path);
+
+	if (fd < 0) {
+		fprintf(stderr, "wgobfs-xdp: %s: %s, is the program attached?\n",
+			path, strerror(errno));
+		exit(1);
+	}
+
+	return fd;
+}
+
+static int ifindex_of(const char *dev)
+{
+	int ifindex = if_nametoindex(dev);
+
+	if (!ifindex)
+		die_errno(dev);
+
+	return ifindex;
+}
+
+static int cmd_attach(int argc, char **argv, bool detach)
+{
+	LIBBPF_OPTS(bpf_object_open_opts, open_opts,
+		    .pin_root_path = WGOBFS_XDP_PIN_DIR);
+	const char *path = WGOBFS_XDP_OBJ;
+	struct bpf_program *p;
+	struct bpf_object *obj;
+	__u32 flags = XDP_FLAGS_DRV_MODE;
+	int ifindex, c, err;
+
+	while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+		switch (c) {
+		case OPT_GENERIC:
+			flags = XDP_FLAGS_SKB_MODE;
+			break;
+		case OPT_OBJ:
+			if (detach)
+				usage();
+			path = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		usage();
+	ifindex = ifindex_of(argv[optind]);
+
+	if (detach) {
+		err = bpf_xdp_detach(ifindex, flags, NULL);
+		if (err) {
+			errno = -err;
+			die_errno("detach");
+		}
+		return 0;
+	}
+
+	if (mkdir(WGOBFS_XDP_PIN_DIR, 0700) && errno != EEXIST)
+		die_errno(WGOBFS_XDP_PIN_DIR);
+
+	obj = bpf_object__open_file(path, &open_opts);
+	err = libbpf_get_error(obj);
+	if (err) {
+		errno = -err;
+		die_errno(path);
+	}
+
+	/* reuses the pinned maps, and their keys, if there are any */
+	err = bpf_object__load(obj);
+	if (err) {
+		errno = -err;
+		die_errno("load");
+	}
+
+	p = bpf_object__find_program_by_name(obj, "wgobfs_xdp_unobfs");
+	if (!p)
+		die("no wgobfs_xdp_unobfs in the object");
+
+	err = bpf_xdp_attach(ifindex, bpf_program__fd(p),
+			     flags | XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
+	if (err) {
+		errno = -err;
+		die_errno("attach");
+	}
+
+	/* the program stays attached after the object is closed */
+	bpf_object__close(obj);
+	return 0;
+}
+
+/* as libxt_WGOBFS, the key is repeated up to the chacha key size */
+static void key_set(struct wgobfs_xdp_key *k, const char *s)
+{
+	const size_t len = strlen(s);
+	unsigned char b[XT_CHACHA_KEY_SIZE];
+	int i;
+
+	for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+		b[i] = s[i % len];
+	for (i = 0; i < 8; i++)
+		k->words[i] = b[i * 4] | b[i * 4 + 1] << 8 |
+			      b[i * 4 + 2] << 16 | (__u32) b[i * 4 + 3] << 24;
+	strcpy(k->key, s);
+}
+
+static int cmd_key(int argc, char **argv, bool add)
+{
+	struct wgobfs_xdp_key k = { .rounds = XT_WGOBFS_DEFAULT_ROUNDS };
+	struct wgobfs_xdp_port port = { 0 };
+	const char *key = NULL;
+	bool have_port = false;
+	int fd, c;
+
+	while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+		switch (c) {
+		case OPT_SPORT:
+		case OPT_DPORT:
+			port.port = parse_num(optarg, 1, 65535, "port");
+			port.dir = c == OPT_SPORT ? WGOBFS_XDP_SPORT :
+						    WGOBFS_XDP_DPORT;
+			have_port = true;
+			break;
+		case OPT_KEY:
+			if (!add)
+				usage();
+			if (!*optarg || strlen(optarg) > XT_WGOBFS_MAX_KEY_SIZE)
+				die("the key is 1 to 32 characters");
+			key = optarg;
+			break;
+		case OPT_ROUNDS:
+			if (!add)
+				usage();
+			k.rounds = parse_num(optarg, 4, 12, "rounds");
+			if (k.rounds & 1 || k.rounds == 10)
+				die("--rounds must be 4, 6, 8 or 12");
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc || !have_port || (add && !key))
+		usage();
+
+	fd = map_open(KEYS_PIN);
+	if (!add) {
+		if (bpf_map_delete_elem(fd, &port))
+			die_errno("delete");
+		return 0;
+	}
+
+	key_set(&k, key);
+	if (bpf_map_update_elem(fd, &port, &k, BPF_ANY))
+		die_errno("add");
+
+	return 0;
+}
+
+static int cmd_list(void)
+{
+	struct wgobfs_xdp_port port, next;
+	struct wgobfs_xdp_key k;
+	void *prev = NULL;
+	int fd;
+
+	fd = map_open(KEYS_PIN);
+	while (!bpf_map_get_next_key(fd, prev, &next)) {
+		port = next;
+		prev = &port;
+		if (bpf_map_lookup_elem(fd, &port, &k))
+			continue;
+		printf("--%s %u --key %s --rounds %u\n",
+		       port.dir == WGOBFS_XDP_SPORT ? "sport" : "dport",
+		       port.port, k.key, k.rounds);
+	}
+
+	return 0;
+}
+
+/* summed over the CPUs, as /proc/net/xt_wgobfs */
+static int cmd_stats(void)
+{
+	const int ncpus = libbpf_num_possible_cpus();
+	unsigned long long sum;
+	__u64 *v;
+	__u32 i, j;
+	int fd;
+
+	if (ncpus < 1)
+		die("cannot count the CPUs");
+
+	v = calloc(ncpus, sizeof(*v));
+	if (!v)
+		die("out of memory");
+
+	fd = map_open(STATS_PIN);
+	for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+		j = stats[i].stat;
+		if (bpf_map_lookup_elem(fd, &j, v))
+			die_errno("stats");
+		for (sum = 0, j = 0; j < (__u32) ncpus; j++)
+			sum += v[j];
+		printf("%s %llu\n", stats[i].name, sum);
+	}
+
+	free(v);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	prog = argv[0];
+	if (argc < 2)
+		usage();
+
+	/* the options come after the command */
+	optind = 2;
+	if (!strcmp(argv[1], "attach"))
+		return cmd_attach(argc, argv, false);
+	if (!strcmp(argv[1], "detach"))
+		return cmd_attach(argc, argv, true);
+	if (!strcmp(argv[1], "add"))
+		return cmd_key(argc, argv, true);
+	if (!strcmp(argv[1], "delete"))
+		return cmd_key(argc, argv, false);
+	if (!strcmp(argv[1], "list") && argc == 2)
+		return cmd_list();
+	if (!strcmp(argv[1], "stats") && argc == 2)
+		return cmd_stats();
+
+	usage();
+	return 2;
+}
@@ -0,0 +1,340 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * XDP program of --unobfs. It restores obfuscated WireGuard messages in the
+ * driver, before an skb is allocated, and drops those sent to a WG port that
+ * do not decode. Restored packets have the padding cut with
+ * bpf_xdp_adjust_tail() and their checksums updated, as xt_unobfs() does.
+ *
+ * Only the chacha PRF is done here, without handshake limits. IP fragments
+ * and VLAN stacks deeper than one tag are passed unchanged. A --unobfs rule
+ * on the same port would drop what this restores, see README.md.
+ */
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/udp.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "wgobfs_xdp.h"
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#include "../src/chacha_rounds.h"
+
+/* as xt_WGOBFS_main.c and wg.h */
+#define WG_HANDSHAKE_INIT       0x01
+#define WG_HANDSHAKE_RESP       0x02
+#define WG_COOKIE               0x03
+#define WG_DATA                 0x04
+#define OBFS_WG_HANDSHAKE_INIT  0x11
+#define OBFS_WG_HANDSHAKE_RESP  0x12
+#define WG_MIN_LEN              32
+#define MIN_RND_LEN             4
+#define MAX_RND_LEN             32
+
+enum wg_message_lengths {
+	WG_INIT_LEN = 148,
+	WG_RESP_LEN = 92,
+	WG_COOKIE_MSG_LEN = 64,
+	WG_MAC2_LEN = 16,
+	WG_INIT_MAC2 = WG_INIT_LEN - WG_MAC2_LEN,
+	WG_RESP_MAC2 = WG_RESP_LEN - WG_MAC2_LEN
+};
+
+/* head PRN, the mask of the first 16 bytes and of the padding length */
+#define HEAD_PRN_WORDS 5
+#define HEAD_PRN_LEN (HEAD_PRN_WORDS * 4)
+
+/* bounds the datagram for the verifier, larger than any WG message */
+#define MAX_DATA_LEN 0x3fff
+
+#define VLAN_HLEN 4
+#define IP_FRAG_MASK 0x3fff
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, WGOBFS_XDP_MAX_KEYS);
+	__type(key, struct wgobfs_xdp_port);
+	__type(value, struct wgobfs_xdp_key);
+	__uint(pinning, LIBBPF_PIN_BY_NAME);
+} wgobfs_keys SEC(".maps");
+
+/* the counters of /proc/net/xt_wgobfs, only those of --unobfs are used */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, XT_WGOBFS_STAT_MAX);
+	__type(key, __u32);
+	__type(value, __u64);
+	__uint(pinning, LIBBPF_PIN_BY_NAME);
+} wgobfs_stats SEC(".maps");
+
+static __always_inline void stat_add(const __u32 i, const __u64 n)
+{
+	__u64 *v = bpf_map_lookup_elem(&wgobfs_stats, &i);
+
+	if (v)
+		*v += n;
+}
+
+static __always_inline __u32 le32_at(const __u8 *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (__u32) p[3] << 24;
+}
+
+/* chacha_hash() of the 16th to 31st bytes of the WG message, only the words
+ * before the nonce are needed
+ */
+static __always_inline void head_prn(const struct wgobfs_xdp_key *k,
+				     const __u8 *in, __u8 *out)
+{
+	__u32 x[16], w;
+	int i;
+
+	x[0] = CHACHA20_CONSTANT_EXPA;
+	x[1] = CHACHA20_CONSTANT_ND_3;
+	x[2] = CHACHA20_CONSTANT_2_BY;
+	x[3] = CHACHA20_CONSTANT_TE_K;
+	for (i = 0; i < 8; i++)
+		x[4 + i] = k->words[i];
+	for (i = 0; i < 4; i++)
+		x[12 + i] = le32_at(in + i * 4);
+
+	for (i = 0; i < 6; i++) {
+		if (i * 2 >= k->rounds)
+			break;
+		DOUBLE_ROUND(x);
+	}
+
+	x[0] += CHACHA20_CONSTANT_EXPA;
+	x[1] += CHACHA20_CONSTANT_ND_3;
+	x[2] += CHACHA20_CONSTANT_2_BY;
+	x[3] += CHACHA20_CONSTANT_TE_K;
+	x[4] += k->words[0];
+	for (i = 0; i < HEAD_PRN_WORDS; i++) {
+		w = x[i];
+		out[i * 4] = w;
+		out[i * 4 + 1] = w >> 8;
+		out[i * 4 + 2] = w >> 16;
+		out[i * 4 + 3] = w >> 24;
+	}
+}
+
+/* the one's complement sum of @len bytes at an even offset of the datagram,
+ * not folded
+ */
+static __always_inline __u32 csum_bytes(const __u8 *p, const int len,
+					const void *end)
+{
+	__u32 sum = 0;
+	int i;
+
+	for (i = 0; i < MAX_RND_LEN; i += 2) {
+		if (i >= len || (void *) (p + i + 1) > end)
+			break;
+		if (i + 1 < len && (void *) (p + i + 2) <= end)
+			sum += p[i] << 8 | p[i + 1];
+		else
+			sum += p[i] << 8;
+	}
+
+	return sum;
+}
+
+static __always_inline __u16 csum_fold16(__u32 sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+/* RFC 1624, the new check field when bytes summing to @old become @new */
+static __always_inline __u16 csum_replace(const __u16 check, const __u32 old,
+					  const __u32 new)
+{
+	return ~csum_fold16((__u16) ~check + (__u16) ~csum_fold16(old) +
+			    csum_fold16(new));
+}
+
+/* as unobfs_check(), the padding length or minus the counter of the drop */
+static __always_inline int wg_check(const __u8 *msg, const int data_len,
+				    const __u8 *prn, __u8 *type,
+				    const void *end)
+{
+	const __u8 *last = msg + data_len - 1;
+	int rnd_len, msg_len;
+
+	if ((void *) (last + 1) > end)
+		return -XT_WGOBFS_STAT_DROP_SHORT;
+
+	rnd_len = *last ^ prn[16];
+	if (rnd_len < MIN_RND_LEN || rnd_len > MAX_RND_LEN)
+		return -XT_WGOBFS_STAT_DROP_BAD_PAD;
+
+	/* message type, then 3 reserved zero bytes */
+	if (msg[1] != prn[1] || msg[2] != prn[2] || msg[3] != prn[3])
+		return -XT_WGOBFS_STAT_DROP_INVALID;
+
+	msg_len = data_len - rnd_len;
+	*type = msg[0] ^ prn[0];
+	switch (*type) {
+	case WG_HANDSHAKE_INIT:
+	case OBFS_WG_HANDSHAKE_INIT:
+		if (msg_len != WG_INIT_LEN)
+			return -XT_WGOBFS_STAT_DROP_INVALID;
+		break;
+	case WG_HANDSHAKE_RESP:
+	case OBFS_WG_HANDSHAKE_RESP:
+		if (msg_len != WG_RESP_LEN)
+			return -XT_WGOBFS_STAT_DROP_INVALID;
+		break;
+	case WG_COOKIE:
+		if (msg_len != WG_COOKIE_MSG_LEN)
+			return -XT_WGOBFS_STAT_DROP_INVALID;
+		break;
+	case WG_DATA:
+		if (msg_len < WG_MIN_LEN || msg_len % 16)
+			return -XT_WGOBFS_STAT_DROP_INVALID;
+		break;
+	default:
+		return -XT_WGOBFS_STAT_DROP_INVALID;
+	}
+
+	return rnd_len;
+}
+
+static __always_inline const struct wgobfs_xdp_key *
+key_lookup(const struct udphdr *udph)
+{
+	struct wgobfs_xdp_port port = {
+		.port = bpf_ntohs(udph->dest),
+		.dir = WGOBFS_XDP_DPORT,
+	};
+	const struct wgobfs_xdp_key *k;
+
+	k = bpf_map_lookup_elem(&wgobfs_keys, &port);
+	if (k)
+		return k;
+
+	port.port = bpf_ntohs(udph->source);
+	port.dir = WGOBFS_XDP_SPORT;
+	return bpf_map_lookup_elem(&wgobfs_keys, &port);
+}
+
+SEC("xdp")
+int wgobfs_xdp_unobfs(struct xdp_md *ctx)
+{
+	void *data = (void *) (long) ctx->data;
+	void *end = (void *) (long) ctx->data_end;
+	const struct wgobfs_xdp_key *k;
+	struct ethhdr *eth = data;
+	struct udphdr *udph;
+	struct iphdr *iph;
+	__u8 prn[HEAD_PRN_LEN];
+	__u8 *msg, *mac2 = NULL, type;
+	__u32 old_sum, new_sum;
+	__u16 proto, udp_len, ip_len;
+	int data_len, rnd_len, trim, i;
+	void *l3_end;
+
+	if ((void *) (eth + 1) > end)
+		return XDP_PASS;
+
+	iph = (void *) (eth + 1);
+	proto = eth->h_proto;
+	if (proto == bpf_htons(ETH_P_8021Q) || proto == bpf_htons(ETH_P_8021AD)) {
+		if ((void *) iph + VLAN_HLEN > end)
+			return XDP_PASS;
+		proto = *(__be16 *) ((void *) iph + 2);
+		iph = (void *) iph + VLAN_HLEN;
+	}
+
+	if (proto != bpf_htons(ETH_P_IP) || (void *) (iph + 1) > end ||
+	    iph->version != 4 || iph->ihl < 5 || iph->protocol != IPPROTO_UDP ||
+	    iph->frag_off & bpf_htons(IP_FRAG_MASK))
+		return XDP_PASS;
+
+	udph = (void *) iph + iph->ihl * 4;
+	if ((void *) (udph + 1) > end)
+		return XDP_PASS;
+
+	k = key_lookup(udph);
+	if (!k)
+		return XDP_PASS;
+
+	/* from here on, the packet is for WG, drop what does not decode */
+	udp_len = bpf_ntohs(udph->len);
+	ip_len = bpf_ntohs(iph->tot_len);
+	data_len = udp_len - (int) sizeof(*udph);
+	l3_end = (void *) iph + ip_len;
+	msg = (void *) (udph + 1);
+	if (data_len < WG_MIN_LEN || data_len > MAX_DATA_LEN ||
+	    ip_len != iph->ihl * 4 + udp_len || l3_end > end ||
+	    (void *) (msg + WG_MIN_LEN) > end) {
+		stat_add(XT_WGOBFS_STAT_DROP_SHORT, 1);
+		return XDP_DROP;
+	}
+
+	head_prn(k, msg + 16, prn);
+	rnd_len = wg_check(msg, data_len, prn, &type, end);
+	if (rnd_len < 0) {
+		stat_add(-rnd_len, 1);
+		return XDP_DROP;
+	}
+
+	if (type == OBFS_WG_HANDSHAKE_INIT)
+		mac2 = msg + WG_INIT_MAC2;
+	else if (type == OBFS_WG_HANDSHAKE_RESP)
+		mac2 = msg + WG_RESP_MAC2;
+	if (mac2 && (void *) (mac2 + WG_MAC2_LEN) > end) {
+		stat_add(XT_WGOBFS_STAT_DROP_SHORT, 1);
+		return XDP_DROP;
+	}
+
+	/* the head, the mac2 and the padding go, the head comes back restored,
+	 * the length is in the pseudo header and the UDP header
+	 */
+	old_sum = csum_bytes(msg, 16, end) + 2 * (__u32) udp_len;
+	if (mac2)
+		old_sum += csum_bytes(mac2, WG_MAC2_LEN, end);
+	old_sum += csum_bytes(msg + data_len - rnd_len, rnd_len, end);
+
+	for (i = 0; i < 16; i++)
+		msg[i] ^= prn[i];
+	msg[0] &= 0x0F;
+	if (mac2)
+		for (i = 0; i < WG_MAC2_LEN; i++)
+			mac2[i] = 0;
+
+	udp_len -= rnd_len;
+	new_sum = csum_bytes(msg, 16, end) + 2 * (__u32) udp_len;
+
+	/* a 0 checksum means the peer sent none */
+	if (udph->check) {
+		udph->check = bpf_htons(csum_replace(bpf_ntohs(udph->check),
+						     old_sum, new_sum));
+		if (!udph->check)
+			udph->check = 0xffff;
+	}
+	udph->len = bpf_htons(udp_len);
+	iph->check = bpf_htons(csum_replace(bpf_ntohs(iph->check), ip_len,
+					    ip_len - rnd_len));
+	iph->tot_len = bpf_htons(ip_len - rnd_len);
+
+	/* the padding and an Ethernet trailer. The barrier keeps clang from
+	 * turning this into arithmetic on the end pointer, which the verifier
+	 * rejects.
+	 */
+	trim = end - l3_end;
+	asm volatile("" : "+r"(trim));
+	trim += rnd_len;
+	if (bpf_xdp_adjust_tail(ctx, -trim)) {
+		stat_add(XT_WGOBFS_STAT_DROP_UNSHARE, 1);
+		return XDP_DROP;
+	}
+
+	stat_add(XT_WGOBFS_STAT_UNOBFS_PKTS, 1);
+	stat_add(XT_WGOBFS_STAT_UNOBFS_BYTES, ip_len - rnd_len);
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "Dual MIT/GPL";
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * The maps shared by the XDP program and wgobfs-xdp. libbpf pins them by name
+ * in WGOBFS_XDP_PIN_DIR, every interface with the program uses the same keys.
+ */
+#ifndef _WGOBFS_XDP_H
+#define _WGOBFS_XDP_H
+
+#include <linux/types.h>
+#include "../src/xt_WGOBFS.h"
+
+#define WGOBFS_XDP_PIN_DIR "/sys/fs/bpf/wgobfs"
+#define WGOBFS_XDP_MAX_KEYS 64
+
+/* as --sport and --dport of the iptables rule */
+enum wgobfs_xdp_dir {
+	WGOBFS_XDP_DPORT,
+	WGOBFS_XDP_SPORT
+};
+
+struct wgobfs_xdp_port {
+	__u16 port;		/* host byte order */
+	__u8 dir;		/* enum wgobfs_xdp_dir */
+	__u8 pad;
+};
+
+struct wgobfs_xdp_key {
+	__u32 words[8];		/* chacha key words, as chacha_init_state() */
+	__u32 rounds;		/* 4, 6, 8 or 12 */
+	char key[XT_WGOBFS_MAX_KEY_SIZE + 1];	/* for wgobfs-xdp list */
+};
+
+#endif /* _WGOBFS_XDP_H */
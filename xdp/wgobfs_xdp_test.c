@@ -0,0 +1,460 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/*
+ * Round trip check of the XDP program, for make check.
+ *
+ *   wgobfs_xdp_test gen -p <port> <plain.pcap>
+ *   wgobfs_xdp_test run -p <port> -k <key> [-r <rounds>] [-o <obj>]
+ *                   <obfs.pcap> <restored.pcap>
+ *
+ * gen writes Ethernet frames of plain WG messages to the port, some with a
+ * VLAN tag, and some to another port. bench/wgobfs_pcap obfuscates them and
+ * restores them again with the module code. run passes each obfuscated frame
+ * to wgobfs_xdp_unobfs with BPF_PROG_TEST_RUN, it must come out as the module
+ * restored it, and be dropped when a masked byte of the head is changed.
+ *
+ * run loads the object with its maps unpinned, it needs CAP_BPF but leaves
+ * nothing behind.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "wgobfs_xdp.h"
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define LINKTYPE_ETHERNET 1
+
+#define ETH_HLEN 14
+#define VLAN_HLEN 4
+#define IP_HLEN 20
+#define UDP_HLEN 8
+#define MAX_FRAME 2048
+
+#define WG_PORT 51820
+#define PER_KIND 16
+
+/* type and length of the messages of gen, as wgtraffic */
+static const struct {
+	unsigned char type;
+	unsigned short len;
+} kinds[] = {
+	{ 1, 148 },		/* handshake initiation */
+	{ 2, 92 },		/* handshake response */
+	{ 3, 64 },		/* cookie reply */
+	{ 4, 32 },		/* keepalive */
+	{ 4, 48 },
+	{ 4, 96 },
+	{ 4, 160 },
+	{ 4, 224 },
+	{ 4, 576 },
+	{ 4, 1376 },
+};
+
+struct frame {
+	const unsigned char *data;
+	unsigned int len;
+};
+
+struct capture {
+	unsigned char *buf;
+	struct frame *frames;
+	unsigned int n;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s gen -p port plain.pcap\n"
+		"       %s run -p port -k key [-r rounds] [-o obj]"
+		" obfs.pcap restored.pcap\n",
+		prog, prog);
+	exit(2);
+}
+
+static unsigned int rnd_state = 0x2545f491;
+
+static unsigned int rnd32(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static unsigned int csum_add(unsigned int sum, const unsigned char *p,
+			     unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += p[i] << 8 | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+
+	return sum;
+}
+
+static unsigned short csum_fold(unsigned int sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+static void put16(unsigned char *p, const unsigned int v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/* an Ethernet frame of a WG message, with both checksums */
+static unsigned int make_frame(unsigned char *f, const int kind,
+			       const bool vlan, const int dport,
+			       const unsigned int id)
+{
+	const unsigned int wg_len = kinds[kind].len;
+	unsigned char *ip, *udp, *msg;
+	unsigned int i, sum;
+
+	memset(f, 0, ETH_HLEN + VLAN_HLEN);
+	memcpy(f, "\x02\x00\x00\x00\x00\x02\x02\x00\x00\x00\x00\x01", 12);
+	ip = f + ETH_HLEN;
+	if (vlan) {
+		put16(f + 12, 0x8100);
+		put16(f + 14, 7);
+		ip += VLAN_HLEN;
+	}
+	put16(ip - 2, 0x0800);
+
+	udp = ip + IP_HLEN;
+	msg = udp + UDP_HLEN;
+	for (i = 0; i < wg_len; i++)
+		msg[i] = rnd32();
+	msg[0] = kinds[kind].type;
+	msg[1] = msg[2] = msg[3] = 0;
+	/* no cookie, the mac2 of the handshake messages is 0 */
+	if (kinds[kind].type == 1 || kinds[kind].type == 2)
+		memset(msg + wg_len - 16, 0, 16);
+
+	memset(ip, 0, IP_HLEN);
+	ip[0] = 0x45;
+	put16(ip + 2, IP_HLEN + UDP_HLEN + wg_len);
+	put16(ip + 4, id);
+	put16(ip + 6, 0x4000);		/* DF */
+	ip[8] = 64;
+	ip[9] = 17;
+	memcpy(ip + 12, "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+	put16(ip + 10, csum_fold(csum_add(0, ip, IP_HLEN)));
+
+	put16(udp, WG_PORT);
+	put16(udp + 2, dport);
+	put16(udp + 4, UDP_HLEN + wg_len);
+	put16(udp + 6, 0);
+	sum = csum_add(0, ip + 12, 8) + 17 + UDP_HLEN + wg_len;
+	sum = csum_fold(csum_add(sum, udp, UDP_HLEN + wg_len));
+	put16(udp + 6, sum ? sum : 0xffff);
+
+	return msg + wg_len - f;
+}
+
+static int cmd_gen(const int port, const char *path)
+{
+	const unsigned int hdr[6] = { PCAP_MAGIC_NS, 2 | 4 << 16, 0, 0,
+				      MAX_FRAME, LINKTYPE_ETHERNET };
+	unsigned char f[MAX_FRAME];
+	unsigned int rec[4], id = 0, len;
+	FILE *out;
+	int k, i;
+
+	out = fopen(path, "w");
+	if (!out) {
+		perror(path);
+		return 1;
+	}
+
+	fwrite(hdr, sizeof(hdr), 1, out);
+	for (k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++) {
+		for (i = 0; i <= PER_KIND; i++) {
+			/* the last one of a kind is for another port */
+			len = make_frame(f, k, i % 4 == 3,
+					 i == PER_KIND ? port + 1 : port, id);
+			rec[0] = id;
+			rec[1] = 0;
+			rec[2] = rec[3] = len;
+			fwrite(rec, sizeof(rec), 1, out);
+			fwrite(f, len, 1, out);
+			id++;
+		}
+	}
+
+	if (fclose(out)) {
+		perror(path);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* the pcap files of gen and wgobfs_pcap, in the byte order of this host */
+static int pcap_read(const char *path, struct capture *cap)
+{
+	unsigned int *hdr, rec[4];
+	size_t size, off, max = 0;
+	FILE *in;
+
+	in = fopen(path, "r");
+	if (!in) {
+		perror(path);
+		return -1;
+	}
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	rewind(in);
+	cap->buf = malloc(size);
+	if (!cap->buf || fread(cap->buf, 1, size, in) != size) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		fclose(in);
+		return -1;
+	}
+	fclose(in);
+
+	hdr = (unsigned int *)cap->buf;
+	if (size < 24 || (hdr[0] != PCAP_MAGIC_NS && hdr[0] != PCAP_MAGIC_US) ||
+	    hdr[5] != LINKTYPE_ETHERNET) {
+		fprintf(stderr, "%s: not an Ethernet pcap\n", path);
+		return -1;
+	}
+
+	cap->n = 0;
+	cap->frames = NULL;
+	for (off = 24; off + sizeof(rec) <= size; off += sizeof(rec) + rec[2]) {
+		memcpy(rec, cap->buf + off, sizeof(rec));
+		if (rec[2] > MAX_FRAME || off + sizeof(rec) + rec[2] > size) {
+			fprintf(stderr, "%s: malformed at offset %zu\n", path,
+				off);
+			return -1;
+		}
+		if (cap->n == max) {
+			max = max ? max * 2 : 256;
+			cap->frames = realloc(cap->frames,
+					      max * sizeof(*cap->frames));
+			if (!cap->frames) {
+				fprintf(stderr, "out of memory\n");
+				return -1;
+			}
+		}
+		cap->frames[cap->n].data = cap->buf + off + sizeof(rec);
+		cap->frames[cap->n].len = rec[2];
+		cap->n++;
+	}
+
+	return 0;
+}
+
+/* the offset of the WG message in a frame of gen */
+static unsigned int msg_offset(const struct frame *f)
+{
+	unsigned int off = ETH_HLEN;
+
+	if (f->data[12] == 0x81 && f->data[13] == 0x00)
+		off += VLAN_HLEN;
+
+	return off + (f->data[off] & 0x0f) * 4 + UDP_HLEN;
+}
+
+/* as key_set() of wgobfs-xdp */
+static void key_set(struct wgobfs_xdp_key *k, const char *s)
+{
+	const size_t len = strlen(s);
+	unsigned char b[XT_CHACHA_KEY_SIZE];
+	int i;
+
+	for (i = 0; i < XT_CHACHA_KEY_SIZE; i++)
+		b[i] = s[i % len];
+	for (i = 0; i < 8; i++)
+		k->words[i] = b[i * 4] | b[i * 4 + 1] << 8 |
+			      b[i * 4 + 2] << 16 | (__u32) b[i * 4 + 3] << 24;
+	strcpy(k->key, s);
+}
+
+static int test_run(const int fd, const struct frame *in, unsigned char *out,
+		    __u32 *out_len, __u32 *retval)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, opts,
+		    .data_in = in->data,
+		    .data_size_in = in->len,
+		    .data_out = out,
+		    .data_size_out = MAX_FRAME,
+		    .repeat = 1);
+	int err;
+
+	err = bpf_prog_test_run_opts(fd, &opts);
+	if (err) {
+		fprintf(stderr, "wgobfs_xdp_test: test run: %s\n",
+			strerror(-err));
+		return -1;
+	}
+	*out_len = opts.data_size_out;
+	*retval = opts.retval;
+	return 0;
+}
+
+static int cmd_run(const char *obj_path, const int port, const char *key,
+		   const unsigned int rounds, const char *obfs_path,
+		   const char *restored_path)
+{
+	struct wgobfs_xdp_key k = { .rounds = rounds };
+	struct wgobfs_xdp_port p = { .port = port, .dir = WGOBFS_XDP_DPORT };
+	struct capture obfs, restored;
+	unsigned char out[MAX_FRAME], bad[MAX_FRAME];
+	struct frame corrupt = { .data = bad };
+	unsigned int i, done = 0, passed = 0, fails = 0, off;
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	struct bpf_map *map;
+	__u32 out_len, ret;
+	int prog_fd, keys_fd, err;
+
+	if (pcap_read(obfs_path, &obfs) || pcap_read(restored_path, &restored))
+		return 1;
+	if (obfs.n != restored.n) {
+		fprintf(stderr, "wgobfs_xdp_test: %u obfuscated frames, %u restored\n",
+			obfs.n, restored.n);
+		return 1;
+	}
+
+	obj = bpf_object__open_file(obj_path, NULL);
+	err = libbpf_get_error(obj);
+	if (err) {
+		fprintf(stderr, "wgobfs_xdp_test: %s: %s\n", obj_path,
+			strerror(-err));
+		return 1;
+	}
+	/* nothing pinned, the maps go with the object */
+	bpf_object__for_each_map(map, obj)
+		bpf_map__set_pin_path(map, NULL);
+	err = bpf_object__load(obj);
+	if (err) {
+		fprintf(stderr, "wgobfs_xdp_test: load: %s\n", strerror(-err));
+		return 1;
+	}
+
+	prog = bpf_object__find_program_by_name(obj, "wgobfs_xdp_unobfs");
+	keys_fd = bpf_object__find_map_fd_by_name(obj, "wgobfs_keys");
+	if (!prog || keys_fd < 0) {
+		fprintf(stderr, "wgobfs_xdp_test: not the wgobfs_xdp object\n");
+		return 1;
+	}
+	prog_fd = bpf_program__fd(prog);
+
+	key_set(&k, key);
+	if (bpf_map_update_elem(keys_fd, &p, &k, BPF_ANY)) {
+		perror("wgobfs_xdp_test: key");
+		return 1;
+	}
+
+	for (i = 0; i < obfs.n; i++) {
+		const struct frame *in = &obfs.frames[i];
+		const struct frame *want = &restored.frames[i];
+		const bool xform = in->len != want->len ||
+				   memcmp(in->data, want->data, in->len);
+
+		if (test_run(prog_fd, in, out, &out_len, &ret))
+			return 1;
+		if (ret != XDP_PASS || out_len != want->len ||
+		    memcmp(out, want->data, out_len)) {
+			fprintf(stderr,
+				"frame %u: action %u, %u bytes, want %u, %u bytes%s\n",
+				i, ret, out_len, XDP_PASS, want->len,
+				ret == XDP_PASS && out_len == want->len ?
+				", content differs" : "");
+			fails++;
+			continue;
+		}
+		if (!xform) {
+			passed++;
+			continue;
+		}
+		done++;
+
+		/* a changed reserved byte of the head does not decode */
+		memcpy(bad, in->data, in->len);
+		off = msg_offset(in);
+		bad[off + 1] ^= 0x01;
+		corrupt.len = in->len;
+		if (test_run(prog_fd, &corrupt, out, &out_len, &ret))
+			return 1;
+		if (ret != XDP_DROP) {
+			fprintf(stderr, "frame %u: corrupted, action %u, want drop\n",
+				i, ret);
+			fails++;
+		}
+	}
+
+	printf("frames %u, restored %u, passed %u, failed %u\n", obfs.n, done,
+	       passed, fails);
+
+	bpf_object__close(obj);
+	free(obfs.frames);
+	free(obfs.buf);
+	free(restored.frames);
+	free(restored.buf);
+	return fails || !done;
+}
+
+int main(int argc, char **argv)
+{
+	const char *obj = "wgobfs_xdp.o", *key = NULL;
+	unsigned int rounds = XT_WGOBFS_DEFAULT_ROUNDS;
+	int port = -1, opt;
+	bool gen;
+
+	if (argc < 2)
+		usage(argv[0]);
+	if (!strcmp(argv[1], "gen"))
+		gen = true;
+	else if (!strcmp(argv[1], "run"))
+		gen = false;
+	else
+		usage(argv[0]);
+
+	/* the options come after the command */
+	optind = 2;
+	while ((opt = getopt(argc, argv, "p:k:r:o:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'k':
+			key = optarg;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'o':
+			obj = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (port < 1 || port > 65534)
+		usage(argv[0]);
+	if (gen) {
+		if (argc - optind != 1)
+			usage(argv[0]);
+		return cmd_gen(port, argv[optind]);
+	}
+
+	if (!key || !*key || strlen(key) > XT_WGOBFS_MAX_KEY_SIZE ||
+	    argc - optind != 2)
+		usage(argv[0]);
+	return cmd_run(obj, port, key, rounds, argv[optind], argv[optind + 1]);
+}